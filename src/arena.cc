@@ -0,0 +1,118 @@
+/*******************************************************************************
+   Filename: arena.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for Arena. Allocation bumps a pointer through
+             blocks that double in size as the drawing grows. Freeing the most
+             recent allocation rewinds the pointer, as undo does; other small
+             blocks go on a free list by size for the next allocation of that
+             size; larger ones wait for Reset().
+*******************************************************************************/
+
+#include <cstdlib>
+#include "arena.h"
+
+Arena gDocumentArena;
+
+Arena::Arena() {
+  mTop = mEnd = NULL;
+  mLiveBytes = 0;
+  memset(mFreeSlots, 0, sizeof(mFreeSlots));
+}
+
+Arena::~Arena() {
+  vector<Block>::iterator iter;
+  for (iter = mBlocks.begin(); iter < mBlocks.end(); ++iter) {
+    free(iter->data);
+  }
+}
+
+void *Arena::Allocate(size_t size) {
+  size = RoundUp(size);
+  mLiveBytes += size;
+  int sizeClass = size / ARENA_ALIGNMENT - 1;
+  if (sizeClass < ARENA_SIZE_CLASSES && mFreeSlots[sizeClass]) {
+    FreeSlot *slot = mFreeSlots[sizeClass];
+    mFreeSlots[sizeClass] = slot->next;
+    return slot;
+  }
+  if ((size_t) (mEnd - mTop) < size) {
+    AddBlock(size);
+  }
+  void *p = mTop;
+  mTop += size;
+
+  return p;
+}
+
+void Arena::Free(void *p, size_t size) {
+  if (!p) {
+    return;
+  }
+  size = RoundUp(size);
+  mLiveBytes -= size;
+  if ((char *) p + size == mTop) {
+    mTop = (char *) p;
+    return;
+  }
+  int sizeClass = size / ARENA_ALIGNMENT - 1;
+  if (sizeClass < ARENA_SIZE_CLASSES) {
+    FreeSlot *slot = (FreeSlot *) p;
+    slot->next = mFreeSlots[sizeClass];
+    mFreeSlots[sizeClass] = slot;
+  }
+}
+
+// Frees everything allocated so far without running any destructors. Only
+// the newest (and largest) block is kept, ready for the next drawing.
+void Arena::Reset() {
+  if (!mBlocks.empty()) {
+    for (int i = 0; i + 1 < (int) mBlocks.size(); ++i) {
+      free(mBlocks[i].data);
+    }
+    mBlocks.erase(mBlocks.begin(), mBlocks.end() - 1);
+    mTop = mBlocks[0].data;
+    mEnd = mTop + mBlocks[0].size;
+  }
+  memset(mFreeSlots, 0, sizeof(mFreeSlots));
+  mLiveBytes = 0;
+}
+
+size_t Arena::ReservedBytes() const {
+  size_t total = 0;
+  vector<Block>::const_iterator iter;
+  for (iter = mBlocks.begin(); iter < mBlocks.end(); ++iter) {
+    total += iter->size;
+  }
+
+  return total;
+}
+
+size_t Arena::RoundUp(size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+
+  return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+// The rest of the current block is abandoned, so blocks double in size to
+// keep the waste (and the number of blocks Reset() frees) small.
+void Arena::AddBlock(size_t minSize) {
+  Block block;
+  block.size = mBlocks.empty() ? ARENA_FIRST_BLOCK_SIZE :
+                                 mBlocks.back().size * 2;
+  while (block.size < minSize) {
+    block.size *= 2;
+  }
+  block.data = (char *) malloc(block.size);
+  if (!block.data) {
+    cerr << "Error: out of memory allocating " << block.size << " bytes."
+         << endl;
+    exit(1);
+  }
+  mBlocks.push_back(block);
+  mTop = block.data;
+  mEnd = block.data + block.size;
+}
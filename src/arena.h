@@ -0,0 +1,49 @@
+/*******************************************************************************
+   Filename: arena.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for Arena, a bump allocator that owns every object
+             belonging to the current drawing. The whole drawing is freed at
+             once by Reset().
+*******************************************************************************/
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include "draw.h"
+
+const size_t ARENA_ALIGNMENT = 16;
+const size_t ARENA_FIRST_BLOCK_SIZE = 64 * 1024;
+const int ARENA_SIZE_CLASSES = 16;  // freed blocks of 16..256 bytes are reused
+
+class Arena {
+ public:
+  Arena();
+  ~Arena();
+  void *Allocate(size_t size);
+  void Free(void *p, size_t size);
+  void Reset();
+  size_t LiveBytes() const { return mLiveBytes; }
+  size_t ReservedBytes() const;
+ private:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+  struct FreeSlot {
+    FreeSlot *next;
+  };
+  static size_t RoundUp(size_t size);
+  void AddBlock(size_t minSize);
+
+  vector<Block> mBlocks;
+  char *mTop, *mEnd;  // unused part of the newest block
+  FreeSlot *mFreeSlots[ARENA_SIZE_CLASSES];
+  size_t mLiveBytes;
+};
+
+extern Arena gDocumentArena;  // shapes and pending points
+
+#endif  // ARENA_H_
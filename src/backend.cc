@@ -0,0 +1,438 @@
+/*******************************************************************************
+   Filename: backend.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for RenderBackend and its implementations.
+             The OpenGL backends map the frame's view onto the modelview
+             matrix, so they draw the same pixels as the others for any view;
+             in the window the view is the identity.
+*******************************************************************************/
+
+#include <cstdio>
+#include "backend.h"
+#include "meshcache.h"
+#include "renderer.h"
+#include "renderthread.h"
+
+RenderBackend::RenderBackend() {
+  mWidth = mHeight = 0;
+  mLeft = mBottom = 0.0;
+  mScale = 1.0;
+  mClip.left = mClip.bottom = mClip.right = mClip.top = 0;
+  mNumShapes = mNumRuns = mNumVertices = 0;
+}
+
+// Starts a frame of the given size in pixels, showing the drawing from
+// (left, bottom) at scale pixels per drawing pixel. With a clip rectangle,
+// only the pixels inside it are redrawn and the rest keep their contents.
+void RenderBackend::BeginFrame(int width, int height, double left,
+                               double bottom, double scale,
+                               const PixelRect *clip) {
+  mWidth = width;
+  mHeight = height;
+  mLeft = left;
+  mBottom = bottom;
+  mScale = scale;
+  mClip.left = clip ? max(clip->left, 0) : 0;
+  mClip.bottom = clip ? max(clip->bottom, 0) : 0;
+  mClip.right = clip ? min(clip->right, width) : width;
+  mClip.top = clip ? min(clip->top, height) : height;
+  mNumShapes = mNumRuns = mNumVertices = 0;
+  StartFrame();
+}
+
+// Brings the meshes of the shapes that reach into the clip rectangle up to
+// date and draws them, in drawing order, as one stream.
+void RenderBackend::DrawShapes(const vector<Shape *> &shapes) {
+  mVisible.clear();
+  vector<Shape *>::const_iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    if (!IsOutsideClip(*iter)) {
+      mVisible.push_back(*iter);
+    }
+  }
+  mNumShapes += mVisible.size();
+  mVertices.clear();
+  mRuns.clear();
+  gMeshCache.Prepare(mVisible);
+  gMeshCache.AppendMeshes(mVisible, &mVertices, &mRuns);
+  DrawStream(mVertices, mRuns);
+}
+
+bool RenderBackend::IsOutsideClip(const Shape *shape) const {
+  double left, bottom, right, top;
+  shape->GetBounds(&left, &bottom, &right, &top);
+  return (right - mLeft) * mScale + SHAPE_BOUNDS_MARGIN < mClip.left ||
+         (left - mLeft) * mScale - SHAPE_BOUNDS_MARGIN > mClip.right ||
+         (top - mBottom) * mScale + SHAPE_BOUNDS_MARGIN < mClip.bottom ||
+         (bottom - mBottom) * mScale - SHAPE_BOUNDS_MARGIN > mClip.top;
+}
+
+void RenderBackend::CountStream(const vector<Vertex> &vertices,
+                                const vector<DrawRun> &runs) {
+  mNumRuns += runs.size();
+  mNumVertices += vertices.size();
+}
+
+static void PushView(double left, double bottom, double scale) {
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glScaled(scale, scale, 1.0);
+  glTranslated(-left, -bottom, 0.0);
+}
+
+static void PopView() {
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+}
+
+//
+// ImmediateBackend methods:
+//
+
+void ImmediateBackend::StartFrame() {
+  PushView(mLeft, mBottom, mScale);
+}
+
+void ImmediateBackend::DrawStream(const vector<Vertex> &vertices,
+                                  const vector<DrawRun> &runs) {
+  vector<DrawRun>::const_iterator iter;
+  for (iter = runs.begin(); iter < runs.end(); ++iter) {
+    glBegin(iter->mode);
+    for (int i = iter->first; i < iter->first + iter->count; ++i) {
+      glColor4ub(vertices[i].r, vertices[i].g, vertices[i].b, vertices[i].a);
+      glVertex2f(vertices[i].x, vertices[i].y);
+    }
+    glEnd();
+  }
+  CountStream(vertices, runs);
+}
+
+bool ImmediateBackend::EndFrame() {
+  PopView();
+
+  return true;
+}
+
+//
+// BufferedBackend methods:
+//
+
+BufferedBackend::BufferedBackend() {
+  mRenderer = new VertexBufferRenderer();
+}
+
+BufferedBackend::~BufferedBackend() {
+  delete mRenderer;
+}
+
+void BufferedBackend::StartFrame() {
+  PushView(mLeft, mBottom, mScale);
+}
+
+// Only shapes marked dirty since the last frame are re-tessellated. Every
+// shape is drawn, whatever the clip rectangle: culling would repack the
+// buffer, and the scissor test discards the pixels outside it anyway.
+void BufferedBackend::DrawShapes(const vector<Shape *> &shapes) {
+  mRenderer->Draw(shapes);
+  mNumShapes += shapes.size();
+  mNumRuns += mRenderer->NumBatches();
+  mNumVertices += mRenderer->NumVertices();
+}
+
+void BufferedBackend::DrawStream(const vector<Vertex> &vertices,
+                                 const vector<DrawRun> &runs) {
+  if (vertices.empty()) {
+    return;
+  }
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &vertices[0].x);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &vertices[0].r);
+  vector<DrawRun>::const_iterator iter;
+  for (iter = runs.begin(); iter < runs.end(); ++iter) {
+    glDrawArrays(iter->mode, iter->first, iter->count);
+  }
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  CountStream(vertices, runs);
+}
+
+bool BufferedBackend::EndFrame() {
+  PopView();
+
+  return true;
+}
+
+void BufferedBackend::Invalidate() {
+  mRenderer->Invalidate();
+}
+
+//
+// SoftwareBackend methods:
+//
+
+SoftwareBackend::SoftwareBackend(const char *filename) {
+  mRasterizer = NULL;
+  if (filename) {
+    mFilename = filename;
+  }
+}
+
+SoftwareBackend::~SoftwareBackend() {
+  delete mRasterizer;
+}
+
+// The image is kept between frames, so only the clip rectangle is cleared.
+void SoftwareBackend::StartFrame() {
+  if (!mRasterizer || mRasterizer->GetWidth() != mWidth ||
+      mRasterizer->GetHeight() != mHeight) {
+    delete mRasterizer;
+    mRasterizer = new SoftwareRasterizer(mWidth, mHeight);
+  }
+  mRasterizer->SetView(mLeft, mBottom, mScale);
+  mRasterizer->SetClip(mClip);
+  mRasterizer->Clear(RENDER_BACKGROUND, RENDER_BACKGROUND, RENDER_BACKGROUND);
+}
+
+void SoftwareBackend::DrawStream(const vector<Vertex> &vertices,
+                                 const vector<DrawRun> &runs) {
+  mRasterizer->Draw(vertices, runs);
+  CountStream(vertices, runs);
+}
+
+bool SoftwareBackend::EndFrame() {
+  if (!mFilename.empty()) {
+    return mRasterizer->WritePPM(mFilename.c_str());
+  }
+  if (mClip.left >= mClip.right || mClip.bottom >= mClip.top) {
+    return true;
+  }
+
+  // copy just the clip rectangle out of the image
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, mRasterizer->GetWidth());
+  glRasterPos2i(mClip.left, mClip.bottom);
+  glDrawPixels(mClip.right - mClip.left, mClip.top - mClip.bottom, GL_RGB,
+               GL_UNSIGNED_BYTE, mRasterizer->GetPixels() +
+                                 (mClip.bottom * mRasterizer->GetWidth() +
+                                  mClip.left) * 3);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+  return true;
+}
+
+//
+// ThreadedBackend methods:
+//
+
+ThreadedBackend::ThreadedBackend(bool toWindow) {
+  mThread = new RenderThread();
+  mToWindow = toWindow;
+  mLastSerial = 0;
+  mLastWidth = mLastHeight = 0;
+  mLastClip = mClip;
+}
+
+ThreadedBackend::~ThreadedBackend() {
+  delete mThread;
+}
+
+// Starts the next snapshot. It replaces any snapshot the render thread hasn't
+// taken yet, so its clip rectangle takes in that one's too; at a new size,
+// the whole image has to be redrawn.
+void ThreadedBackend::StartFrame() {
+  if (mWidth != mLastWidth || mHeight != mLastHeight) {
+    mClip.left = mClip.bottom = 0;
+    mClip.right = mWidth;
+    mClip.top = mHeight;
+  } else if (mThread->IsScenePending() && mClip.left < mClip.right &&
+             mClip.bottom < mClip.top) {
+    mClip.left = min(mClip.left, mLastClip.left);
+    mClip.bottom = min(mClip.bottom, mLastClip.bottom);
+    mClip.right = max(mClip.right, mLastClip.right);
+    mClip.top = max(mClip.top, mLastClip.top);
+  }
+  SceneSnapshot *scene = mThread->GetScene();
+  scene->width = mWidth;
+  scene->height = mHeight;
+  scene->left = mLeft;
+  scene->bottom = mBottom;
+  scene->scale = mScale;
+  scene->clip = mClip;
+  scene->vertices.clear();
+  scene->runs.clear();
+}
+
+void ThreadedBackend::DrawStream(const vector<Vertex> &vertices,
+                                 const vector<DrawRun> &runs) {
+  SceneSnapshot *scene = mThread->GetScene();
+  int offset = scene->vertices.size();
+  scene->vertices.insert(scene->vertices.end(), vertices.begin(),
+                         vertices.end());
+  vector<DrawRun>::const_iterator iter;
+  for (iter = runs.begin(); iter < runs.end(); ++iter) {
+    DrawRun run = *iter;
+    run.first += offset;
+    scene->runs.push_back(run);
+  }
+  CountStream(vertices, runs);
+}
+
+// Publishes the snapshot, unless there is nothing in it to redraw, and shows
+// the newest frame the render thread has finished at this size, if any.
+bool ThreadedBackend::EndFrame() {
+  if (mClip.left < mClip.right && mClip.bottom < mClip.top) {
+    mLastSerial = mThread->PublishScene();
+    mLastWidth = mWidth;
+    mLastHeight = mHeight;
+    mLastClip = mClip;
+  }
+  if (!mToWindow) {
+    return true;
+  }
+  const RenderedFrame *frame = mThread->TakeFrame();
+  if (frame && frame->width == mWidth && frame->height == mHeight) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glRasterPos2i(0, 0);
+    glDrawPixels(frame->width, frame->height, GL_RGB, GL_UNSIGNED_BYTE,
+                 &frame->pixels[0]);
+  }
+
+  return true;
+}
+
+bool ThreadedBackend::HasNewFrame() const {
+  return mThread->HasNewFrame();
+}
+
+// Returns the newest frame the render thread has finished, or NULL if there
+// is none yet.
+const RenderedFrame *ThreadedBackend::TakeFrame() {
+  return mThread->TakeFrame();
+}
+
+// Returns the frame last shown or taken, or NULL if there is none.
+const RenderedFrame *ThreadedBackend::GetFrame() const {
+  return mThread->GetFrame();
+}
+
+//
+// SvgBackend methods:
+//
+
+SvgBackend::SvgBackend(const char *filename) {
+  mFilename = filename;
+}
+
+// An SVG file holds a whole frame, so the clip rectangle only culls shapes.
+void SvgBackend::StartFrame() {
+  mFile.close();
+  mFile.clear();
+  mFile.open(mFilename.c_str(), ios::out | ios::trunc);
+
+  // crisp edges keep the seams between a fan's triangles from showing
+  mFile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << mWidth
+        << "\" height=\"" << mHeight << "\" viewBox=\"0 0 " << mWidth << " "
+        << mHeight << "\" shape-rendering=\"crispEdges\">\n"
+        << "<rect width=\"" << mWidth << "\" height=\"" << mHeight
+        << "\" fill=\"#ffffff\"/>\n";
+}
+
+// Consecutive primitives of one color share a path element.
+void SvgBackend::DrawStream(const vector<Vertex> &vertices,
+                            const vector<DrawRun> &runs) {
+  vector<DrawRun>::const_iterator iter;
+  for (iter = runs.begin(); iter < runs.end(); ++iter) {
+    bool triangles = iter->mode == GL_TRIANGLES;
+    int step = triangles ? 3 : 2;
+    const Vertex *color = NULL;
+    for (int i = iter->first; i + step <= iter->first + iter->count;
+         i += step) {
+      const Vertex &v = vertices[i];
+      if (!color || v.r != color->r || v.g != color->g || v.b != color->b) {
+        if (color) {
+          mFile << "\"/>\n";
+        }
+        char hex[8];
+        snprintf(hex, sizeof(hex), "#%02x%02x%02x", v.r, v.g, v.b);
+        if (triangles) {
+          mFile << "<path fill=\"" << hex << "\" d=\"";
+        } else {
+          mFile << "<path fill=\"none\" stroke=\"" << hex << "\" d=\"";
+        }
+        color = &v;
+      }
+      WritePoint(v, 'M');
+      for (int j = 1; j < step; ++j) {
+        WritePoint(vertices[i + j], 'L');
+      }
+      if (triangles) {
+        mFile << "Z";
+      }
+    }
+    if (color) {
+      mFile << "\"/>\n";
+    }
+  }
+  CountStream(vertices, runs);
+}
+
+// SVG's y axis points down, so rows are counted from the top of the frame.
+void SvgBackend::WritePoint(const Vertex &vertex, char command) {
+  mFile << command << (vertex.x - mLeft) * mScale << " "
+        << mHeight - (vertex.y - mBottom) * mScale;
+}
+
+bool SvgBackend::EndFrame() {
+  mFile << "</svg>\n";
+  mFile.close();
+
+  return !mFile.fail();
+}
+
+//
+// Backend selection:
+//
+
+// Returns a new backend of the given mode, or NULL if the mode needs a
+// filename and none was given. A software backend given a filename writes
+// there instead of to the window.
+RenderBackend *CreateRenderBackend(RenderMode mode, const char *filename) {
+  switch (mode) {
+    case IMMEDIATE_RENDERING:
+      return new ImmediateBackend();
+    case RETAINED_RENDERING:
+      return new BufferedBackend();
+    case SOFTWARE_RENDERING:
+      return new SoftwareBackend(filename);
+    case SVG_RENDERING:
+      return filename ? new SvgBackend(filename) : NULL;
+    default:
+      return NULL;
+  }
+}
+
+RenderMode ParseRenderMode(const char *name) {
+  for (int i = 0; i < NUM_RENDER_MODES; ++i) {
+    if (strcmp(name, RENDER_MODE_NAMES[i]) == 0) {
+      return (RenderMode) i;
+    }
+  }
+
+  return NUM_RENDER_MODES;
+}
+
+// The suffix of the files a backend writes, or NULL if it writes none.
+const char *GetRenderFileSuffix(RenderMode mode) {
+  switch (mode) {
+    case SOFTWARE_RENDERING:
+      return ".ppm";
+    case SVG_RENDERING:
+      return ".svg";
+    default:
+      return NULL;
+  }
+}
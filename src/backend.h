@@ -0,0 +1,170 @@
+/*******************************************************************************
+   Filename: backend.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for RenderBackend, the interface through which the
+             drawing's shapes reach the screen or a file, and its
+             implementations: immediate-mode OpenGL, buffered OpenGL, the
+             tiled CPU rasterizer (in the frame or on a render thread of its
+             own), and an SVG writer. Every backend receives
+             the same stream of tessellated vertices, grouped into runs that
+             share a primitive mode, so they can be compared on identical
+             scenes.
+*******************************************************************************/
+
+#ifndef BACKEND_H_
+#define BACKEND_H_
+
+#include <fstream>
+#include <string>
+#include "shapes.h"
+#include "raster.h"
+
+class VertexBufferRenderer;
+class RenderThread;
+struct RenderedFrame;
+
+const char *const RENDER_MODE_NAMES[NUM_RENDER_MODES] = {
+  "immediate", "retained", "software", "svg"
+};
+
+class RenderBackend {
+ public:
+  RenderBackend();
+  virtual ~RenderBackend() {}
+  virtual RenderMode GetMode() const = 0;
+  void BeginFrame(int width, int height, double left, double bottom,
+                  double scale, const PixelRect *clip = NULL);
+  virtual void DrawShapes(const vector<Shape *> &shapes);
+  virtual void DrawStream(const vector<Vertex> &vertices,
+                          const vector<DrawRun> &runs) = 0;
+  // Finishes the frame, returning false if it couldn't be shown or written.
+  virtual bool EndFrame() = 0;
+  virtual void Invalidate() {}
+  // A backend that draws on another thread shows each frame late, when it
+  // has finished; the window polls for them.
+  virtual bool HasNewFrame() const { return false; }
+  int NumShapes() const { return mNumShapes; }
+  int NumRuns() const { return mNumRuns; }
+  int NumVertices() const { return mNumVertices; }
+  // OpenGL calls that drew the frame: one per run, unless overridden.
+  virtual int NumDrawCalls() const { return mNumRuns; }
+ protected:
+  // Called by BeginFrame once the frame's view and clip rectangle are set.
+  virtual void StartFrame() = 0;
+  bool IsOutsideClip(const Shape *shape) const;
+  void CountStream(const vector<Vertex> &vertices,
+                   const vector<DrawRun> &runs);
+
+  int mWidth, mHeight;
+  double mLeft, mBottom, mScale;  // pixel x = (x - mLeft) * mScale, etc.
+  PixelRect mClip;                // the pixels this frame may change
+  vector<Shape *> mVisible;       // scratch space for DrawShapes
+  vector<Vertex> mVertices;
+  vector<DrawRun> mRuns;
+  // drawn in the current or last frame
+  int mNumShapes, mNumRuns, mNumVertices;
+};
+
+// Issues a glBegin/glEnd pair per run and a call per vertex.
+class ImmediateBackend : public RenderBackend {
+ public:
+  RenderMode GetMode() const { return IMMEDIATE_RENDERING; }
+  void DrawStream(const vector<Vertex> &vertices,
+                  const vector<DrawRun> &runs);
+  bool EndFrame();
+ protected:
+  void StartFrame();
+};
+
+// Keeps the shapes' vertices in a VertexBufferRenderer between frames and
+// draws each run with one call; streams it didn't pack are drawn straight
+// from client memory.
+class BufferedBackend : public RenderBackend {
+ public:
+  BufferedBackend();
+  ~BufferedBackend();
+  RenderMode GetMode() const { return RETAINED_RENDERING; }
+  void DrawShapes(const vector<Shape *> &shapes);
+  void DrawStream(const vector<Vertex> &vertices,
+                  const vector<DrawRun> &runs);
+  bool EndFrame();
+  void Invalidate();
+ protected:
+  void StartFrame();
+ private:
+  VertexBufferRenderer *mRenderer;
+};
+
+// Rasterizes on the thread pool, then copies the image to the window or, if
+// given a filename, writes it there as a PPM.
+class SoftwareBackend : public RenderBackend {
+ public:
+  SoftwareBackend(const char *filename = NULL);
+  ~SoftwareBackend();
+  RenderMode GetMode() const { return SOFTWARE_RENDERING; }
+  void DrawStream(const vector<Vertex> &vertices,
+                  const vector<DrawRun> &runs);
+  bool EndFrame();
+  int NumDrawCalls() const { return mFilename.empty() ? 1 : 0; }
+  const SoftwareRasterizer *GetRasterizer() const { return mRasterizer; }
+ protected:
+  void StartFrame();
+ private:
+  SoftwareRasterizer *mRasterizer;
+  string mFilename;
+};
+
+// Rasterizes on a RenderThread, so a frame costs the calling thread only the
+// culling and tessellation of the shapes in its clip rectangle. Frames from
+// the render thread are shown as they are finished, each one whole, so the
+// window should be redrawn in full; the clip rectangle still limits what is
+// rasterized. Shown without a window, frames are only kept.
+class ThreadedBackend : public RenderBackend {
+ public:
+  ThreadedBackend(bool toWindow = true);
+  ~ThreadedBackend();
+  RenderMode GetMode() const { return SOFTWARE_RENDERING; }
+  void DrawStream(const vector<Vertex> &vertices,
+                  const vector<DrawRun> &runs);
+  bool EndFrame();
+  int NumDrawCalls() const { return mToWindow ? 1 : 0; }
+  bool HasNewFrame() const;
+  const RenderedFrame *TakeFrame();
+  const RenderedFrame *GetFrame() const;
+  long NumScenesPublished() const { return mLastSerial; }
+ protected:
+  void StartFrame();
+ private:
+  RenderThread *mThread;
+  bool mToWindow;
+  long mLastSerial;           // of the last snapshot published
+  int mLastWidth, mLastHeight;
+  PixelRect mLastClip;        // and the region it covered
+};
+
+// Writes each frame to a file as an SVG image, one path per run of
+// consecutive same-colored triangles or lines.
+class SvgBackend : public RenderBackend {
+ public:
+  SvgBackend(const char *filename);
+  RenderMode GetMode() const { return SVG_RENDERING; }
+  void DrawStream(const vector<Vertex> &vertices,
+                  const vector<DrawRun> &runs);
+  bool EndFrame();
+ protected:
+  void StartFrame();
+ private:
+  void WritePoint(const Vertex &vertex, char command);
+
+  string mFilename;
+  ofstream mFile;
+};
+
+RenderBackend *CreateRenderBackend(RenderMode mode,
+                                   const char *filename = NULL);
+RenderMode ParseRenderMode(const char *name);
+const char *GetRenderFileSuffix(RenderMode mode);
+
+#endif  // BACKEND_H_
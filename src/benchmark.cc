@@ -0,0 +1,1027 @@
+/*******************************************************************************
+   Filename: benchmark.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Command-line benchmarks. Each builds a random scene, times the
+             old and new versions of an operation on it, checks that both
+             agree, and prints the results.
+*******************************************************************************/
+
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shapes.h"
+#include "spatial.h"
+#include "savefile.h"
+#include "journal.h"
+#include "raster.h"
+#include "backend.h"
+#include "threadpool.h"
+#include "renderthread.h"
+#include "meshcache.h"
+#include "bezier.h"
+#include "benchmark.h"
+
+const double BENCHMARK_WIDTH = 1920.0;
+const double BENCHMARK_HEIGHT = 1080.0;
+
+static double RandomCoordinate(double max) {
+  return (double) rand() / RAND_MAX * max;
+}
+
+// Fills shapes with a random mix of every shape type, each fitting inside a
+// 100-pixel box somewhere on a 1920x1080 canvas. With likeMouse, vertices
+// fall on whole pixels and colors come from a few dozen, as when drawing with
+// the mouse and the color buttons.
+static void MakeRandomScene(int numShapes, vector<Shape *> *shapes,
+                            bool likeMouse = false) {
+  const int numVertices[NUM_SHAPE_TYPES] = {0, 2, 4, 2, 3, 5, 2};
+  for (int i = 0; i < numShapes; ++i) {
+    ShapeType type = (ShapeType) (LINE + i % (NUM_SHAPE_TYPES - 1));
+    double x = RandomCoordinate(BENCHMARK_WIDTH - 100.0);
+    double y = RandomCoordinate(BENCHMARK_HEIGHT - 100.0);
+    vector<Point2D *> points;
+    for (int j = 0; j < numVertices[type]; ++j) {
+      double px = x + RandomCoordinate(100.0);
+      double py = y + RandomCoordinate(100.0);
+      if (likeMouse) {
+        px = floor(px);
+        py = floor(py);
+      }
+      points.push_back(new Point2D(px, py));
+    }
+    double r = RandomCoordinate(1.0);
+    double g = RandomCoordinate(1.0);
+    double b = RandomCoordinate(1.0);
+    if (likeMouse) {
+      r = rand() % 4 / 3.0;
+      g = rand() % 4 / 3.0;
+      b = rand() % 4 / 3.0;
+    }
+    bool filled = i % 2 == 0;
+    switch (type) {
+      case LINE:
+        shapes->push_back(new Line(points, r, g, b));
+        break;
+      case BEZIER_CURVE:
+        shapes->push_back(new BezierCurve(points, r, g, b));
+        break;
+      case RECTANGLE:
+        shapes->push_back(new Rectangle(points, r, g, b, filled));
+        break;
+      case TRIANGLE:
+        shapes->push_back(new Triangle(points, r, g, b, filled));
+        break;
+      case PENTAGON:
+        shapes->push_back(new Pentagon(points, r, g, b, filled));
+        break;
+      default:
+        shapes->push_back(new Circle(points, r, g, b, filled));
+        break;
+    }
+    for (int j = 0; j < (int) points.size(); ++j) {
+      delete points[j];
+    }
+  }
+}
+
+// The front-to-back scan mouse() used before the spatial index.
+static bool PickByScan(const vector<Shape *> &shapes, double x, double y,
+                       Shape **shape, int *vertex) {
+  vector<Shape *>::const_iterator shapeIter;
+  for (shapeIter = shapes.begin(); shapeIter < shapes.end(); ++shapeIter) {
+    for (int i = 0; i < (*shapeIter)->NumPoints(); ++i) {
+      if ((*shapeIter)->GetPointAt(i).Contains(x, y)) {
+        *shape = *shapeIter;
+        *vertex = i;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Compares picking by linear scan with picking through SpatialIndex. Half of
+// the clicks land on a random vertex and half land anywhere on the canvas.
+int RunPickingBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  vector<double> clickX, clickY;
+  int numVertices = 0;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  for (int i = 0; i < (int) shapes.size(); ++i) {
+    numVertices += shapes[i]->NumPoints();
+  }
+  for (int i = 0; i < BENCHMARK_CLICKS; ++i) {
+    if (i % 2 == 0 && !shapes.empty()) {
+      Shape *shape = shapes[rand() % shapes.size()];
+      int vertex = rand() % shape->NumPoints();
+      clickX.push_back(shape->GetX(vertex) + 1.0);
+      clickY.push_back(shape->GetY(vertex) - 1.0);
+    } else {
+      clickX.push_back(RandomCoordinate(BENCHMARK_WIDTH));
+      clickY.push_back(RandomCoordinate(BENCHMARK_HEIGHT));
+    }
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  SpatialIndex index;
+  for (int i = 0; i < (int) shapes.size(); ++i) {
+    index.Insert(shapes[i]);
+  }
+  double buildSeconds = chrono::duration<double>(
+                          chrono::steady_clock::now() - start).count();
+
+  vector<Shape *> scannedShapes(BENCHMARK_CLICKS, NULL);
+  vector<Shape *> indexedShapes(BENCHMARK_CLICKS, NULL);
+  vector<int> scannedVertices(BENCHMARK_CLICKS, -1);
+  vector<int> indexedVertices(BENCHMARK_CLICKS, -1);
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_CLICKS; ++i) {
+    PickByScan(shapes, clickX[i], clickY[i],
+               &scannedShapes[i], &scannedVertices[i]);
+  }
+  double scanSeconds = chrono::duration<double>(
+                         chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_CLICKS; ++i) {
+    index.Pick(clickX[i], clickY[i], &indexedShapes[i], &indexedVertices[i]);
+  }
+  double indexSeconds = chrono::duration<double>(
+                          chrono::steady_clock::now() - start).count();
+
+  int mismatches = 0;
+  for (int i = 0; i < BENCHMARK_CLICKS; ++i) {
+    if (scannedShapes[i] != indexedShapes[i] ||
+        scannedVertices[i] != indexedVertices[i]) {
+      ++mismatches;
+    }
+  }
+  cout << "picking: " << shapes.size() << " shapes, " << numVertices
+       << " vertices, " << BENCHMARK_CLICKS << " clicks" << endl;
+  cout << "  index build:  " << buildSeconds * 1000.0 << " ms" << endl;
+  cout << "  linear scan:  " << scanSeconds * 1e6 / BENCHMARK_CLICKS
+       << " us/click" << endl;
+  cout << "  grid index:   " << indexSeconds * 1e6 / BENCHMARK_CLICKS
+       << " us/click" << endl;
+  cout << "  mismatches:   " << mismatches << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// The text loader the LOAD_BUTTON handler used before ParseTextScene: a
+// malloc'd line buffer per line, strtok and atof.
+static void LoadByStrtok(const char *filename, vector<Shape *> *shapes) {
+  ifstream fin(filename);
+  int currentShapeType;
+  vector<double> input;
+  vector<Point2D *> points;
+  while (fin.good()) {
+    char *line = (char *) malloc((INPUT_STR_LEN + 1) * sizeof(char));
+    char *buffer = line;
+    fin >> currentShapeType;
+    if (fin.good()) {
+      fin.getline(line, INPUT_STR_LEN);
+      line = strtok(line, " \n");
+      while (line) {
+        input.push_back(atof(line));
+        line = strtok(NULL, " \n");
+      }
+    }
+    free(buffer);
+    if (!fin.good() || input.size() < 4) {
+      break;
+    }
+    for (int i = 0; i + 4 < (int) input.size(); i += 2) {
+      points.push_back(new Point2D(input[i], input[i + 1]));
+    }
+    int n = input.size();
+    Shape *shape = CreateShape((ShapeType) currentShapeType, points,
+                               input[n - 4], input[n - 3], input[n - 2],
+                               input[n - 1]);
+    if (shape) {
+      shapes->push_back(shape);
+    }
+    for (int i = 0; i < (int) points.size(); ++i) {
+      delete points[i];
+    }
+    points.clear();
+    input.clear();
+  }
+}
+
+static bool SameShape(const Shape *a, const Shape *b) {
+  if (a->GetShapeType() != b->GetShapeType() ||
+      a->NumPoints() != b->NumPoints() ||
+      a->GetColor() != b->GetColor() ||
+      a->IsFilled() != b->IsFilled()) {
+    return false;
+  }
+  for (int i = 0; i < a->NumPoints(); ++i) {
+    if (a->GetX(i) != b->GetX(i) || a->GetY(i) != b->GetY(i)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Compares loading a text save file with the old strtok loader and with
+// ParseTextScene, reporting throughput in megabytes of text per second.
+int RunLoadingBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  vector<Point2D *> noPoints;
+  char filename[] = "/tmp/draw-benchmark-XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    cerr << "Error: unable to create a temporary file." << endl;
+    return 1;
+  }
+  close(fd);
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  SaveScene(filename, TEXT_SAVE_FORMAT, shapes, noPoints);
+  size_t size;
+  const char *text = MapFile(filename, &size);
+  double megabytes = size / (1024.0 * 1024.0);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<Shape *> oldShapes;
+  LoadByStrtok(filename, &oldShapes);
+  double oldSeconds = chrono::duration<double>(
+                        chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  SceneData data;
+  ParseTextScene(text, text + size, &data);
+  double parseSeconds = chrono::duration<double>(
+                          chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  vector<SceneData> chunks;
+  ParseTextSceneInChunks(text, text + size, &chunks);
+  double chunkedSeconds = chrono::duration<double>(
+                            chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  vector<Shape *> newShapes;
+  vector<Point2D *> newPoints;
+  LoadScene(filename, &newShapes, &newPoints);
+  double newSeconds = chrono::duration<double>(
+                        chrono::steady_clock::now() - start).count();
+  UnmapFile(text, size);
+  unlink(filename);
+
+  int mismatches = 0;
+  if (oldShapes.size() != newShapes.size()) {
+    mismatches = abs((int) oldShapes.size() - (int) newShapes.size());
+  }
+  for (int i = 0; i < (int) oldShapes.size() &&
+                  i < (int) newShapes.size(); ++i) {
+    if (!SameShape(oldShapes[i], newShapes[i])) {
+      ++mismatches;
+    }
+  }
+  cout << "loading: " << newShapes.size() << " shapes, " << megabytes
+       << " MB of text" << endl;
+  cout << "  strtok/atof load:   " << oldSeconds * 1000.0 << " ms, "
+       << megabytes / oldSeconds << " MB/s" << endl;
+  cout << "  from_chars parse:   " << parseSeconds * 1000.0 << " ms, "
+       << megabytes / parseSeconds << " MB/s" << endl;
+  cout << "  chunked parse:      " << chunkedSeconds * 1000.0 << " ms, "
+       << megabytes / chunkedSeconds << " MB/s (" << chunks.size()
+       << " chunks, " << GetThreadPool()->NumThreads() << " threads)" << endl;
+  cout << "  from_chars load:    " << newSeconds * 1000.0 << " ms, "
+       << megabytes / newSeconds << " MB/s" << endl;
+  cout << "  mismatches:         " << mismatches << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// Saves a scene, drags random vertices of its shapes one whole pixel at a
+// time (adjusting or moving, and often dragging a rectangle's corner past the
+// opposite edge) while journaling the edits as the program does, then loads
+// the save file, replays the journal and counts the shapes that differ from
+// the edited ones.
+static int CheckJournalReplay(const char *filename,
+                              const vector<Shape *> &shapes,
+                              const vector<Point2D *> &points) {
+  if (!SaveScene(filename, TEXT_SAVE_FORMAT, shapes, points) ||
+      !WriteJournalHeader(filename)) {
+    return 1;
+  }
+  EditJournal journal;
+  journal.Attach(filename, 0);
+  for (int i = 0; i < BENCHMARK_DRAGS; ++i) {
+    int index = rand() % shapes.size();
+    Shape *shape = shapes[index];
+    int vertex = rand() % shape->NumPoints();
+    bool adjust = i % 2 == 0;
+    double startX = shape->GetX(vertex), startY = shape->GetY(vertex);
+    double endX = startX + rand() % 301 - 150;
+    double endY = startY + rand() % 301 - 150;
+    int steps = max(fabs(endX - startX), fabs(endY - startY));
+    for (int j = 1; j <= steps; ++j) {
+      double x = floor(startX + (endX - startX) * j / steps + 0.5);
+      double y = floor(startY + (endY - startY) * j / steps + 0.5);
+      if (adjust) {
+        shape->Adjust(x, y, vertex);
+        journal.RecordAdjustVertex(index, vertex, x, y,
+                                   shape->IsAdjustAbsolute());
+      } else {
+        shape->Move(x, y, vertex);
+        journal.RecordMoveShape(index, vertex, x, y);
+      }
+    }
+  }
+  if (!AppendJournal(filename, journal.TakeRecords())) {
+    return 1;
+  }
+
+  vector<Shape *> replayedShapes;
+  vector<Point2D *> replayedPoints;
+  bool replayed = LoadScene(filename, &replayedShapes, &replayedPoints) &&
+                  ReplayJournal(filename, &replayedShapes,
+                                &replayedPoints) >= 0;
+  unlink(GetJournalFilename(filename).c_str());
+  if (!replayed || replayedShapes.size() != shapes.size()) {
+    return 1;
+  }
+  int mismatches = 0;
+  for (int i = 0; i < (int) shapes.size(); ++i) {
+    if (!SameShape(shapes[i], replayedShapes[i])) {
+      ++mismatches;
+    }
+  }
+
+  return mismatches;
+}
+
+// Saves and reloads a mouse-like scene in every format, checking that each
+// round trip is exact, checks that replaying a journal of drags rebuilds the
+// dragged scene, and checks that the compact format keeps arbitrary
+// coordinates to within half a grid step.
+int RunSavingBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  vector<Point2D *> points;
+  char filename[] = "/tmp/draw-benchmark-XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    cerr << "Error: unable to create a temporary file." << endl;
+    return 1;
+  }
+  close(fd);
+  srand(1);
+  MakeRandomScene(numShapes, &shapes, true);
+  for (int i = 0; i < BENCHMARK_PENDING_POINTS; ++i) {
+    points.push_back(new Point2D(floor(RandomCoordinate(BENCHMARK_WIDTH)),
+                                 floor(RandomCoordinate(BENCHMARK_HEIGHT))));
+  }
+
+  int mismatches = 0;
+  size_t textSize = 0;
+  cout << "saving: " << shapes.size() << " shapes, "
+       << points.size() << " pending points" << endl;
+  for (int format = 0; format < NUM_SAVE_FORMATS; ++format) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SaveScene(filename, (SaveFormat) format, shapes, points);
+    double saveSeconds = chrono::duration<double>(
+                           chrono::steady_clock::now() - start).count();
+    struct stat info;
+    size_t size = stat(filename, &info) == 0 ? info.st_size : 0;
+    if (format == TEXT_SAVE_FORMAT) {
+      textSize = size;
+    }
+
+    start = chrono::steady_clock::now();
+    vector<Shape *> loadedShapes;
+    vector<Point2D *> loadedPoints;
+    LoadScene(filename, &loadedShapes, &loadedPoints);
+    double loadSeconds = chrono::duration<double>(
+                           chrono::steady_clock::now() - start).count();
+
+    int formatMismatches = abs((int) shapes.size() -
+                               (int) loadedShapes.size()) +
+                           abs((int) points.size() -
+                               (int) loadedPoints.size());
+    for (int i = 0; i < (int) shapes.size() &&
+                    i < (int) loadedShapes.size(); ++i) {
+      if (!SameShape(shapes[i], loadedShapes[i])) {
+        ++formatMismatches;
+      }
+    }
+    for (int i = 0; i < (int) points.size() &&
+                    i < (int) loadedPoints.size(); ++i) {
+      if (points[i]->GetX() != loadedPoints[i]->GetX() ||
+          points[i]->GetY() != loadedPoints[i]->GetY()) {
+        ++formatMismatches;
+      }
+    }
+    mismatches += formatMismatches;
+    cout << "  " << SAVE_FORMAT_NAMES[format] << ":\t" << size << " bytes ("
+         << 100.0 * size / textSize << "% of text), save "
+         << saveSeconds * 1000.0 << " ms, load " << loadSeconds * 1000.0
+         << " ms, mismatches " << formatMismatches << endl;
+  }
+  int journalMismatches = CheckJournalReplay(filename, shapes, points);
+  mismatches += journalMismatches;
+  cout << "  journal replay: " << BENCHMARK_DRAGS << " drags, mismatches "
+       << journalMismatches << endl;
+  unlink(filename);
+
+  // off-grid coordinates only survive to within half a grid step
+  vector<Shape *> offGridShapes;
+  MakeRandomScene(numShapes, &offGridShapes);
+  SceneData data, decoded;
+  string encoded;
+  vector<Point2D *> noPoints;
+  SnapshotScene(offGridShapes, noPoints, &data);
+  double grid = 1.0 / 64.0;
+  EncodeCompactScene(data, grid, &encoded);
+  bool decodedOk = DecodeCompactScene(encoded.data(),
+                                      encoded.data() + encoded.size(),
+                                      &decoded);
+  double maxError = 0.0;
+  if (!decodedOk || decoded.xs.size() != data.xs.size() ||
+      decoded.types != data.types || decoded.colors != data.colors ||
+      decoded.counts != data.counts || decoded.filled != data.filled) {
+    ++mismatches;
+  } else {
+    for (int i = 0; i < (int) data.xs.size(); ++i) {
+      maxError = max(maxError, fabs(decoded.xs[i] - data.xs[i]));
+      maxError = max(maxError, fabs(decoded.ys[i] - data.ys[i]));
+    }
+    if (maxError > grid / 2.0) {
+      ++mismatches;
+    }
+  }
+  cout << "  compact, grid " << grid << ": max error " << maxError
+       << " pixels (limit " << grid / 2.0 << ")" << endl;
+  cout << "  mismatches:   " << mismatches << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// Evaluates random curves at random parameter arrays of every length up to
+// BENCHMARK_BEZIER_MAX_T (so the SIMD loops leave every possible tail) with
+// each kernel this CPU supports, timing each and checking that every point
+// agrees with the scalar kernel's to within BENCHMARK_BEZIER_EPSILON.
+int RunBezierBenchmark(int numCurves) {
+  vector<double> xs(4 * numCurves), ys(4 * numCurves);
+  vector<int> firsts(numCurves + 1, 0);
+  srand(1);
+  for (int i = 0; i < numCurves; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      xs[4 * i + j] = RandomCoordinate(BENCHMARK_WIDTH);
+      ys[4 * i + j] = RandomCoordinate(BENCHMARK_HEIGHT);
+    }
+    firsts[i + 1] = firsts[i] + i % (BENCHMARK_BEZIER_MAX_T + 1);
+  }
+  vector<double> ts(firsts[numCurves]);
+  for (int i = 0; i < (int) ts.size(); ++i) {
+    ts[i] = RandomCoordinate(1.0);
+  }
+
+  vector<double> scalarX(ts.size()), scalarY(ts.size());
+  vector<double> outX(ts.size()), outY(ts.size());
+  cout << "evaluating: " << numCurves << " curves, " << ts.size()
+       << " points" << endl;
+  int mismatches = 0;
+  for (int kernel = SCALAR_KERNEL; kernel < NUM_BEZIER_KERNELS; ++kernel) {
+    vector<double> *x = kernel == SCALAR_KERNEL ? &scalarX : &outX;
+    vector<double> *y = kernel == SCALAR_KERNEL ? &scalarY : &outY;
+    bool supported = true;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; supported && i < numCurves; ++i) {
+      supported = EvaluateCubicBezierWith((BezierKernel) kernel,
+                                          &xs[4 * i], &ys[4 * i],
+                                          ts.data() + firsts[i],
+                                          firsts[i + 1] - firsts[i],
+                                          x->data() + firsts[i],
+                                          y->data() + firsts[i]);
+    }
+    double seconds = chrono::duration<double>(
+                       chrono::steady_clock::now() - start).count();
+    cout << "  " << BEZIER_KERNEL_NAMES[kernel] << ": ";
+    if (!supported) {
+      cout << "not supported" << endl;
+      continue;
+    }
+    int kernelMismatches = 0;
+    for (int i = 0; kernel != SCALAR_KERNEL && i < (int) ts.size(); ++i) {
+      if (fabs(outX[i] - scalarX[i]) > BENCHMARK_BEZIER_EPSILON ||
+          fabs(outY[i] - scalarY[i]) > BENCHMARK_BEZIER_EPSILON) {
+        ++kernelMismatches;
+      }
+    }
+    mismatches += kernelMismatches;
+    cout << seconds * 1.0e9 / max((int) ts.size(), 1) << " ns/point, "
+         << "mismatches " << kernelMismatches << endl;
+  }
+
+  // degenerate curves: a point takes one segment, and NaN or huge control
+  // points take the most rather than an undefined cast
+  double pointXs[4] = {1.0, 1.0, 1.0, 1.0}, pointYs[4] = {2.0, 2.0, 2.0, 2.0};
+  double nanXs[4] = {0.0, nan(""), 1.0, 2.0}, nanYs[4] = {0.0, 0.0, 0.0, 0.0};
+  double hugeXs[4] = {0.0, 1.0e300, -1.0e300, 0.0};
+  int segmentMismatches =
+    (CubicBezierSegments(pointXs, pointYs, 1.0) != 1) +
+    (CubicBezierSegments(nanXs, nanYs, 1.0) != MAX_CURVE_SEGMENTS) +
+    (CubicBezierSegments(hugeXs, nanYs, 1.0) != MAX_CURVE_SEGMENTS);
+  mismatches += segmentMismatches;
+  cout << "  segment counts: mismatches " << segmentMismatches << endl;
+  cout << "  mismatches:   " << mismatches << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// Compares drawing a scene with the software rasterizer as one tile on one
+// thread against drawing it in tiles across the thread pool, checking that
+// every pixel agrees.
+int RunRasterBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  vector<Vertex> vertices;
+  vector<DrawRun> runs;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  TessellateShapes(shapes, &vertices, &runs);
+
+  SoftwareRasterizer untiled(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+  untiled.SetTileSize(max(BENCHMARK_WIDTH, BENCHMARK_HEIGHT));
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+    untiled.Clear(RENDER_BACKGROUND, RENDER_BACKGROUND, RENDER_BACKGROUND);
+    untiled.Draw(vertices, runs);
+  }
+  double untiledSeconds = chrono::duration<double>(
+                            chrono::steady_clock::now() - start).count();
+
+  SoftwareRasterizer tiled(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+  long steals = GetThreadPool()->NumSteals();
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+    tiled.Clear(RENDER_BACKGROUND, RENDER_BACKGROUND, RENDER_BACKGROUND);
+    tiled.Draw(vertices, runs);
+  }
+  double tiledSeconds = chrono::duration<double>(
+                          chrono::steady_clock::now() - start).count();
+  steals = GetThreadPool()->NumSteals() - steals;
+
+  int mismatches = 0;
+  int numPixels = tiled.GetWidth() * tiled.GetHeight();
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    if (memcmp(untiled.GetPixels() + i, tiled.GetPixels() + i, 3) != 0) {
+      ++mismatches;
+    }
+  }
+  cout << "rasterizing: " << shapes.size() << " shapes, " << vertices.size()
+       << " vertices, " << tiled.GetWidth() << "x" << tiled.GetHeight()
+       << ", " << BENCHMARK_FRAMES << " frames" << endl;
+  cout << "  one tile:     " << untiledSeconds * 1000.0 / BENCHMARK_FRAMES
+       << " ms/frame" << endl;
+  cout << "  " << tiled.NumTiles() << " tiles:    "
+       << tiledSeconds * 1000.0 / BENCHMARK_FRAMES << " ms/frame ("
+       << GetThreadPool()->NumThreads() << " threads, " << steals
+       << " steals)" << endl;
+  cout << "  mismatches:   " << mismatches << " pixels" << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// Compares tessellating a whole scene inline, one shape after another, with
+// re-tessellating it through MeshCache across the thread pool, as after a
+// large import, and times a frame after a single shape has been moved. Both
+// must produce the same vertices and runs.
+int RunTessellationBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  vector<Vertex> inlineVertices, cachedVertices;
+  vector<DrawRun> inlineRuns, cachedRuns;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+    inlineVertices.clear();
+    inlineRuns.clear();
+    TessellateShapes(shapes, &inlineVertices, &inlineRuns);
+  }
+  double inlineSeconds = chrono::duration<double>(
+                           chrono::steady_clock::now() - start).count();
+
+  MeshCache cache;
+  long steals = GetThreadPool()->NumSteals();
+  double allSeconds = 0.0;
+  for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+    vector<Shape *>::iterator iter;
+    for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+      (*iter)->SetDirty(true);
+    }
+    start = chrono::steady_clock::now();
+    cache.Prepare(shapes);
+    allSeconds += chrono::duration<double>(
+                    chrono::steady_clock::now() - start).count();
+  }
+  steals = GetThreadPool()->NumSteals() - steals;
+
+  double oneSeconds = 0.0;
+  for (int i = 0; i < BENCHMARK_DRAGS; ++i) {
+    Shape *shape = shapes[rand() % shapes.size()];
+    shape->Move(shape->GetX(0) + 1.0, shape->GetY(0), 0);
+    start = chrono::steady_clock::now();
+    cache.Prepare(shapes);
+    oneSeconds += chrono::duration<double>(
+                    chrono::steady_clock::now() - start).count();
+  }
+  inlineVertices.clear();
+  inlineRuns.clear();
+  TessellateShapes(shapes, &inlineVertices, &inlineRuns);
+  cache.AppendMeshes(shapes, &cachedVertices, &cachedRuns);
+
+  bool same = inlineVertices.size() == cachedVertices.size() &&
+              inlineRuns.size() == cachedRuns.size();
+  for (int i = 0; same && i < (int) inlineVertices.size(); ++i) {
+    same = memcmp(&inlineVertices[i], &cachedVertices[i],
+                  sizeof(Vertex)) == 0;
+  }
+  for (int i = 0; same && i < (int) inlineRuns.size(); ++i) {
+    same = inlineRuns[i].first == cachedRuns[i].first &&
+           inlineRuns[i].count == cachedRuns[i].count &&
+           inlineRuns[i].mode == cachedRuns[i].mode;
+  }
+  cout << "tessellating: " << shapes.size() << " shapes, "
+       << inlineVertices.size() << " vertices" << endl;
+  cout << "  inline, every shape:     "
+       << inlineSeconds * 1000.0 / BENCHMARK_FRAMES << " ms/frame" << endl;
+  cout << "  mesh cache, every shape: "
+       << allSeconds * 1000.0 / BENCHMARK_FRAMES << " ms/frame ("
+       << GetThreadPool()->NumThreads() << " threads, " << steals
+       << " steals)" << endl;
+  cout << "  mesh cache, one moved:   "
+       << oneSeconds * 1000.0 / BENCHMARK_DRAGS << " ms/frame" << endl;
+  cout << "  vertices and runs:       " << (same ? "identical" : "DIFFERENT")
+       << endl;
+
+  return same ? 0 : 1;
+}
+
+// Draws the same scene through every backend that can run without a window,
+// writing each frame to a temporary file, and reports the time per frame and
+// what each frame amounted to.
+int RunBackendBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  char filename[] = "/tmp/draw-benchmark-XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    cerr << "Error: unable to create a temporary file." << endl;
+    return 1;
+  }
+  close(fd);
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+
+  int failures = 0;
+  cout << "drawing: " << shapes.size() << " shapes, " << BENCHMARK_WIDTH
+       << "x" << BENCHMARK_HEIGHT << ", " << BENCHMARK_FRAMES << " frames"
+       << endl;
+  for (int mode = 0; mode < NUM_RENDER_MODES; ++mode) {
+    if (!GetRenderFileSuffix((RenderMode) mode)) {
+      cout << "  " << RENDER_MODE_NAMES[mode]
+           << ": needs a window (compare with V and S there)" << endl;
+      continue;
+    }
+    RenderBackend *backend = CreateRenderBackend((RenderMode) mode, filename);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+      backend->BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0);
+      backend->DrawShapes(shapes);
+      if (!backend->EndFrame()) {
+        ++failures;
+      }
+    }
+    double seconds = chrono::duration<double>(
+                       chrono::steady_clock::now() - start).count();
+    struct stat info;
+    off_t size = stat(filename, &info) == 0 ? info.st_size : 0;
+    cout << "  " << RENDER_MODE_NAMES[mode] << ": "
+         << seconds * 1000.0 / BENCHMARK_FRAMES << " ms/frame, "
+         << backend->NumRuns() << " runs, " << backend->NumVertices()
+         << " vertices, " << size << " bytes written" << endl;
+    delete backend;
+  }
+  unlink(filename);
+  if (failures > 0) {
+    cerr << "Error: " << failures << " frames couldn't be written." << endl;
+  }
+
+  return failures == 0 ? 0 : 1;
+}
+
+// Adds a shape's bounds, with room for its handles, to damage as DamageShape
+// does in the window.
+static void AddDamage(const Shape *shape, PixelRect *damage) {
+  double left, bottom, right, top;
+  shape->GetBounds(&left, &bottom, &right, &top);
+  double margin = POINT_RADIUS + SHAPE_BOUNDS_MARGIN;
+  PixelRect rect = {(int) floor(left - margin), (int) floor(bottom - margin),
+                    (int) ceil(right + margin), (int) ceil(top + margin)};
+  if (damage->left >= damage->right || damage->bottom >= damage->top) {
+    *damage = rect;
+  } else {
+    damage->left = min(damage->left, rect.left);
+    damage->bottom = min(damage->bottom, rect.bottom);
+    damage->right = max(damage->right, rect.right);
+    damage->top = max(damage->top, rect.top);
+  }
+}
+
+// Drags random shapes around, redrawing after each step in full and just
+// within the damaged region (the shape's old and new bounds), and checks that
+// both images end up the same. Frames are kept in memory rather than shown.
+int RunDamageBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  SoftwareBackend full, partial;
+  full.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0);
+  full.DrawShapes(shapes);
+  partial.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0);
+  partial.DrawShapes(shapes);
+
+  double fullSeconds = 0.0, partialSeconds = 0.0;
+  long fullPixels = 0, partialPixels = 0;
+  long fullShapes = 0, partialShapes = 0;
+  for (int i = 0; i < BENCHMARK_DRAGS; ++i) {
+    Shape *shape = shapes[rand() % shapes.size()];
+    PixelRect damage = {0, 0, 0, 0};
+    AddDamage(shape, &damage);
+    shape->Move(shape->GetX(0) + RandomCoordinate(40.0) - 20.0,
+                shape->GetY(0) + RandomCoordinate(40.0) - 20.0, 0);
+    AddDamage(shape, &damage);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    full.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0);
+    full.DrawShapes(shapes);
+    chrono::steady_clock::time_point drawn = chrono::steady_clock::now();
+    fullSeconds += chrono::duration<double>(drawn - start).count();
+    partial.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0,
+                       &damage);
+    partial.DrawShapes(shapes);
+    partialSeconds += chrono::duration<double>(
+                        chrono::steady_clock::now() - drawn).count();
+    fullPixels += (long) BENCHMARK_WIDTH * BENCHMARK_HEIGHT;
+    partialPixels += (long) (min(damage.right, (int) BENCHMARK_WIDTH) -
+                             max(damage.left, 0)) *
+                     (min(damage.top, (int) BENCHMARK_HEIGHT) -
+                      max(damage.bottom, 0));
+    fullShapes += full.NumShapes();
+    partialShapes += partial.NumShapes();
+  }
+
+  int mismatches = 0;
+  const SoftwareRasterizer *a = full.GetRasterizer();
+  const SoftwareRasterizer *b = partial.GetRasterizer();
+  int numPixels = a->GetWidth() * a->GetHeight();
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    if (memcmp(a->GetPixels() + i, b->GetPixels() + i, 3) != 0) {
+      ++mismatches;
+    }
+  }
+  cout << "dragging: " << shapes.size() << " shapes, " << BENCHMARK_WIDTH
+       << "x" << BENCHMARK_HEIGHT << ", " << BENCHMARK_DRAGS << " drag steps"
+       << endl;
+  cout << "  full redraw:    " << fullSeconds * 1000.0 / BENCHMARK_DRAGS
+       << " ms/frame, " << fullShapes / BENCHMARK_DRAGS << " shapes, "
+       << fullPixels / BENCHMARK_DRAGS << " pixels" << endl;
+  cout << "  damaged region: " << partialSeconds * 1000.0 / BENCHMARK_DRAGS
+       << " ms/frame, " << partialShapes / BENCHMARK_DRAGS << " shapes, "
+       << partialPixels / BENCHMARK_DRAGS << " pixels" << endl;
+  cout << "  mismatches:     " << mismatches << " pixels" << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+struct DragResult {
+  int frames, edits;
+  double totalLatency, maxLatency;
+};
+
+// Where event i of a drag that starts with the shape's first vertex at
+// (x0, y0) puts that vertex: around a circle of radius 50 pixels.
+static void GetDragPosition(int i, double x0, double y0,
+                            double *x, double *y) {
+  double angle = 2.0 * PI * i / BENCHMARK_DRAG_EVENTS;
+  *x = x0 + 50.0 * cos(angle) - 50.0;
+  *y = y0 + 50.0 * sin(angle);
+}
+
+// Replays a drag of one shape as motion events arriving every
+// BENCHMARK_EVENT_MICROSECONDS, redrawing the damaged region through the
+// software backend. Unpaced, each event that has arrived is applied and a
+// frame drawn as soon as the last one is done, as when motion() applied every
+// event and posted a redisplay. Paced, a tick at DEFAULT_FRAME_RATE applies
+// only the latest position, as FrameTick does, and draws nothing if no event
+// has arrived. Latency runs from the newest event a frame shows to the end of
+// that frame: how far the drawing trails the cursor.
+static void ReplayDrag(const vector<Shape *> &shapes, SpatialIndex *index,
+                       bool paced, DragResult *result) {
+  typedef chrono::steady_clock Clock;
+  SoftwareBackend backend;
+  backend.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0);
+  backend.DrawShapes(shapes);
+  Shape *shape = shapes[0];
+  double x0 = shape->GetX(0), y0 = shape->GetY(0);
+  Clock::duration period = chrono::duration_cast<Clock::duration>(
+                             chrono::duration<double>(1.0 /
+                                                      DEFAULT_FRAME_RATE));
+  memset(result, 0, sizeof(*result));
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point nextFrame = start;
+  int next = 0;  // the first event not yet applied
+  while (next < BENCHMARK_DRAG_EVENTS) {
+    Clock::time_point arrival = start + chrono::microseconds(
+                                  (long) next * BENCHMARK_EVENT_MICROSECONDS);
+    if (paced) {
+      this_thread::sleep_until(nextFrame);
+      nextFrame += period;
+      if (nextFrame < Clock::now()) {
+        nextFrame = Clock::now() + period;
+      }
+    } else {
+      this_thread::sleep_until(arrival);
+    }
+    int last = next;
+    Clock::time_point now = Clock::now();
+    while (last < BENCHMARK_DRAG_EVENTS &&
+           start + chrono::microseconds((long) last *
+                                        BENCHMARK_EVENT_MICROSECONDS) <= now) {
+      ++last;
+    }
+    if (last == next) {
+      continue;
+    }
+
+    PixelRect damage = {0, 0, 0, 0};
+    AddDamage(shape, &damage);
+    for (int i = paced ? last - 1 : next; i < last; ++i) {
+      double x, y;
+      GetDragPosition(i, x0, y0, &x, &y);
+      shape->Move(x, y, 0);
+      index->Update(shape);
+      ++result->edits;
+    }
+    AddDamage(shape, &damage);
+    backend.BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0,
+                       &damage);
+    backend.DrawShapes(shapes);
+
+    double latency = chrono::duration<double>(
+                       Clock::now() - (start + chrono::microseconds(
+                         (long) (last - 1) * BENCHMARK_EVENT_MICROSECONDS)))
+                       .count();
+    result->totalLatency += latency;
+    result->maxLatency = max(result->maxLatency, latency);
+    ++result->frames;
+    next = last;
+  }
+}
+
+// Compares dragging a shape with and without coalescing motion events into
+// paced frames. Each run starts from the same place and has to leave the
+// shape where the last event put it, however many events it skipped.
+int RunDragBenchmark(int numShapes) {
+  vector<Shape *> shapes;
+  SpatialIndex index;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  vector<Shape *>::iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    index.Insert(*iter);
+  }
+
+  cout << "dragging: " << shapes.size() << " shapes, "
+       << BENCHMARK_DRAG_EVENTS << " motion events at "
+       << 1000000 / BENCHMARK_EVENT_MICROSECONDS << " per second" << endl;
+  Shape *shape = shapes[0];
+  double x0 = shape->GetX(0), y0 = shape->GetY(0), finalX, finalY;
+  GetDragPosition(BENCHMARK_DRAG_EVENTS - 1, x0, y0, &finalX, &finalY);
+  int mismatches = 0;
+  for (int paced = 0; paced <= 1; ++paced) {
+    DragResult result;
+    shape->Move(x0, y0, 0);
+    index.Update(shape);
+    ReplayDrag(shapes, &index, paced, &result);
+    if (shape->GetX(0) != finalX || shape->GetY(0) != finalY) {
+      ++mismatches;
+    }
+    if (paced) {
+      cout << "  paced at " << DEFAULT_FRAME_RATE << " fps: ";
+    } else {
+      cout << "  unpaced:        ";
+    }
+    cout << result.frames << " frames, " << result.edits << " edits, "
+         << 1000.0 * result.totalLatency / max(result.frames, 1)
+         << " ms average latency, " << 1000.0 * result.maxLatency
+         << " ms max" << endl;
+  }
+  cout << "  final position mismatches: " << mismatches << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+struct StallResult {
+  double totalSeconds, maxSeconds;  // spent in frames by the calling thread
+};
+
+// Draws a scene in full, as after loading it, then drags its first shape in a
+// circle at DEFAULT_FRAME_RATE, handing each step's damaged region to backend
+// as display() does. Only the time the calling thread spends on frames
+// counts.
+static void ReplaySteps(const vector<Shape *> &shapes, RenderBackend *backend,
+                        StallResult *result) {
+  typedef chrono::steady_clock Clock;
+  Clock::duration period = chrono::duration_cast<Clock::duration>(
+                             chrono::duration<double>(1.0 /
+                                                      DEFAULT_FRAME_RATE));
+  Shape *shape = shapes[0];
+  double x0 = shape->GetX(0), y0 = shape->GetY(0);
+  memset(result, 0, sizeof(*result));
+  Clock::time_point nextFrame = Clock::now();
+  for (int i = 0; i <= BENCHMARK_DRAGS; ++i) {
+    this_thread::sleep_until(nextFrame);
+    nextFrame += period;
+    PixelRect damage = {0, 0, 0, 0};
+    if (i > 0) {
+      double angle = 2.0 * PI * i / BENCHMARK_DRAGS;
+      AddDamage(shape, &damage);
+      shape->Move(x0 + 50.0 * cos(angle) - 50.0, y0 + 50.0 * sin(angle), 0);
+      AddDamage(shape, &damage);
+    }
+
+    Clock::time_point start = Clock::now();
+    backend->BeginFrame(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0.0, 0.0, 1.0,
+                        i > 0 ? &damage : NULL);
+    backend->DrawShapes(shapes);
+    backend->EndFrame();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    result->totalSeconds += seconds;
+    result->maxSeconds = max(result->maxSeconds, seconds);
+  }
+}
+
+// Compares drawing in the frame with drawing on a render thread while a shape
+// is dragged during the first, full frame, then waits for the render thread
+// to catch up and checks that both images agree.
+int RunRenderThreadBenchmark(int numShapes) {
+  vector<Shape *> shapes, threadedShapes;
+  srand(1);
+  MakeRandomScene(numShapes, &shapes);
+  srand(1);
+  MakeRandomScene(numShapes, &threadedShapes);
+
+  SoftwareBackend inFrame;
+  StallResult inFrameResult;
+  ReplaySteps(shapes, &inFrame, &inFrameResult);
+  ThreadedBackend threaded(false);
+  StallResult threadedResult;
+  ReplaySteps(threadedShapes, &threaded, &threadedResult);
+  chrono::steady_clock::time_point stepsDone = chrono::steady_clock::now();
+  const RenderedFrame *frame = threaded.TakeFrame();
+  while (!frame || frame->serial < threaded.NumScenesPublished()) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+    frame = threaded.TakeFrame();
+  }
+  double catchUp = chrono::duration<double>(
+                     chrono::steady_clock::now() - stepsDone).count();
+
+  int mismatches = 0;
+  const SoftwareRasterizer *image = inFrame.GetRasterizer();
+  int numPixels = image->GetWidth() * image->GetHeight();
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    if (memcmp(image->GetPixels() + i, &frame->pixels[i], 3) != 0) {
+      ++mismatches;
+    }
+  }
+  cout << "render thread: " << shapes.size() << " shapes, "
+       << BENCHMARK_WIDTH << "x" << BENCHMARK_HEIGHT
+       << ", a full frame then " << BENCHMARK_DRAGS << " drag steps at "
+       << DEFAULT_FRAME_RATE << " fps" << endl;
+  cout << "  in the frame:     longest stall "
+       << 1000.0 * inFrameResult.maxSeconds << " ms, "
+       << 1000.0 * inFrameResult.totalSeconds / (BENCHMARK_DRAGS + 1)
+       << " ms/frame average" << endl;
+  cout << "  on render thread: longest stall "
+       << 1000.0 * threadedResult.maxSeconds << " ms, "
+       << 1000.0 * threadedResult.totalSeconds / (BENCHMARK_DRAGS + 1)
+       << " ms/frame average; drew " << frame->framesDrawn << " of "
+       << threaded.NumScenesPublished() << " snapshots, caught up "
+       << 1000.0 * catchUp << " ms after the last step" << endl;
+  cout << "  mismatches:       " << mismatches << " pixels" << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+   Filename: benchmark.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for the command-line benchmarks, which run without
+             opening a window.
+*******************************************************************************/
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+const int DEFAULT_BENCHMARK_SHAPES = 25000;
+const int BENCHMARK_CLICKS = 2000;
+const int BENCHMARK_PENDING_POINTS = 3;
+const int BENCHMARK_FRAMES = 10;
+const int BENCHMARK_DRAGS = 100;
+const int BENCHMARK_DRAG_EVENTS = 2000;
+const int BENCHMARK_EVENT_MICROSECONDS = 1000;
+const int BENCHMARK_BEZIER_MAX_T = 37;  // parameter values per curve, at most
+const double BENCHMARK_BEZIER_EPSILON = 1.0e-9;  // pixels
+
+int RunPickingBenchmark(int numShapes);
+int RunLoadingBenchmark(int numShapes);
+int RunSavingBenchmark(int numShapes);
+int RunBezierBenchmark(int numCurves);
+int RunRasterBenchmark(int numShapes);
+int RunTessellationBenchmark(int numShapes);
+int RunBackendBenchmark(int numShapes);
+int RunDamageBenchmark(int numShapes);
+int RunDragBenchmark(int numShapes);
+int RunRenderThreadBenchmark(int numShapes);
+
+#endif  // BENCHMARK_H_
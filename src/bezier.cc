@@ -0,0 +1,221 @@
+/*******************************************************************************
+   Filename: bezier.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Batch cubic Bezier evaluation. Arbitrary parameter values are
+             evaluated in power-basis (Horner) form, four at a time with AVX2
+             or two at a time with SSE2 when the CPU supports it. Evenly spaced
+             parameter values are evaluated by forward differencing, which
+             costs three additions per point.
+*******************************************************************************/
+
+#include "draw.h"
+#include "bezier.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BEZIER_X86_SIMD
+#endif
+
+void ComputeCubicCoefficients(const double *xs, const double *ys,
+                              CubicCoefficients *k) {
+  k->ax = xs[3] - 3.0 * xs[2] + 3.0 * xs[1] - xs[0];
+  k->bx = 3.0 * (xs[2] - 2.0 * xs[1] + xs[0]);
+  k->cx = 3.0 * (xs[1] - xs[0]);
+  k->dx = xs[0];
+  k->ay = ys[3] - 3.0 * ys[2] + 3.0 * ys[1] - ys[0];
+  k->by = 3.0 * (ys[2] - 2.0 * ys[1] + ys[0]);
+  k->cy = 3.0 * (ys[1] - ys[0]);
+  k->dy = ys[0];
+}
+
+static void EvaluateScalar(const CubicCoefficients &k,
+                           const double *ts, int n,
+                           double *outX, double *outY) {
+  for (int i = 0; i < n; ++i) {
+    double t = ts[i];
+    outX[i] = ((k.ax * t + k.bx) * t + k.cx) * t + k.dx;
+    outY[i] = ((k.ay * t + k.by) * t + k.cy) * t + k.dy;
+  }
+}
+
+#ifdef BEZIER_X86_SIMD
+
+__attribute__((target("avx2")))
+static void EvaluateAvx2(const CubicCoefficients &k,
+                         const double *ts, int n,
+                         double *outX, double *outY) {
+  __m256d ax = _mm256_set1_pd(k.ax), ay = _mm256_set1_pd(k.ay);
+  __m256d bx = _mm256_set1_pd(k.bx), by = _mm256_set1_pd(k.by);
+  __m256d cx = _mm256_set1_pd(k.cx), cy = _mm256_set1_pd(k.cy);
+  __m256d dx = _mm256_set1_pd(k.dx), dy = _mm256_set1_pd(k.dy);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d t = _mm256_loadu_pd(ts + i);
+    __m256d x = _mm256_add_pd(_mm256_mul_pd(ax, t), bx);
+    __m256d y = _mm256_add_pd(_mm256_mul_pd(ay, t), by);
+    x = _mm256_add_pd(_mm256_mul_pd(x, t), cx);
+    y = _mm256_add_pd(_mm256_mul_pd(y, t), cy);
+    x = _mm256_add_pd(_mm256_mul_pd(x, t), dx);
+    y = _mm256_add_pd(_mm256_mul_pd(y, t), dy);
+    _mm256_storeu_pd(outX + i, x);
+    _mm256_storeu_pd(outY + i, y);
+  }
+  EvaluateScalar(k, ts + i, n - i, outX + i, outY + i);
+}
+
+__attribute__((target("sse2")))
+static void EvaluateSse2(const CubicCoefficients &k,
+                         const double *ts, int n,
+                         double *outX, double *outY) {
+  __m128d ax = _mm_set1_pd(k.ax), ay = _mm_set1_pd(k.ay);
+  __m128d bx = _mm_set1_pd(k.bx), by = _mm_set1_pd(k.by);
+  __m128d cx = _mm_set1_pd(k.cx), cy = _mm_set1_pd(k.cy);
+  __m128d dx = _mm_set1_pd(k.dx), dy = _mm_set1_pd(k.dy);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d t = _mm_loadu_pd(ts + i);
+    __m128d x = _mm_add_pd(_mm_mul_pd(ax, t), bx);
+    __m128d y = _mm_add_pd(_mm_mul_pd(ay, t), by);
+    x = _mm_add_pd(_mm_mul_pd(x, t), cx);
+    y = _mm_add_pd(_mm_mul_pd(y, t), cy);
+    x = _mm_add_pd(_mm_mul_pd(x, t), dx);
+    y = _mm_add_pd(_mm_mul_pd(y, t), dy);
+    _mm_storeu_pd(outX + i, x);
+    _mm_storeu_pd(outY + i, y);
+  }
+  EvaluateScalar(k, ts + i, n - i, outX + i, outY + i);
+}
+
+#endif  // BEZIER_X86_SIMD
+
+// Evaluates the curve as EvaluateCubicBezier does, but with the given kernel,
+// so the SIMD paths can be checked against the scalar one. Returns false,
+// writing nothing, if this CPU can't run the kernel.
+bool EvaluateCubicBezierWith(BezierKernel kernel,
+                             const double *xs, const double *ys,
+                             const double *ts, int n,
+                             double *outX, double *outY) {
+  CubicCoefficients k;
+  ComputeCubicCoefficients(xs, ys, &k);
+  switch (kernel) {
+    case SCALAR_KERNEL:
+      EvaluateScalar(k, ts, n, outX, outY);
+      return true;
+#ifdef BEZIER_X86_SIMD
+    case SSE2_KERNEL:
+      if (!__builtin_cpu_supports("sse2")) {
+        return false;
+      }
+      EvaluateSse2(k, ts, n, outX, outY);
+      return true;
+    case AVX2_KERNEL:
+      if (!__builtin_cpu_supports("avx2")) {
+        return false;
+      }
+      EvaluateAvx2(k, ts, n, outX, outY);
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+// Evaluates the curve with control points (xs[i], ys[i]) at the n parameter
+// values in ts, writing the results to outX and outY.
+void EvaluateCubicBezier(const double *xs, const double *ys,
+                         const double *ts, int n,
+                         double *outX, double *outY) {
+  CubicCoefficients k;
+  ComputeCubicCoefficients(xs, ys, &k);
+#ifdef BEZIER_X86_SIMD
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  static const bool hasSse2 = __builtin_cpu_supports("sse2");
+  if (hasAvx2 && n >= 4) {
+    EvaluateAvx2(k, ts, n, outX, outY);
+    return;
+  }
+  if (hasSse2 && n >= 2) {
+    EvaluateSse2(k, ts, n, outX, outY);
+    return;
+  }
+#endif
+  EvaluateScalar(k, ts, n, outX, outY);
+}
+
+// Evaluates the curve at t = i / segments for i = 0..segments, so outX and
+// outY must hold segments + 1 values. The last point is set to the end control
+// point exactly so round-off never opens a gap between joined curves.
+void EvaluateCubicBezierUniform(const double *xs, const double *ys,
+                                int segments,
+                                double *outX, double *outY) {
+  CubicCoefficients k;
+  ComputeCubicCoefficients(xs, ys, &k);
+  double h = 1.0 / segments;
+  double h2 = h * h;
+  double h3 = h2 * h;
+  double fx = k.dx;
+  double fy = k.dy;
+  double dfx = k.ax * h3 + k.bx * h2 + k.cx * h;
+  double dfy = k.ay * h3 + k.by * h2 + k.cy * h;
+  double ddfx = 6.0 * k.ax * h3 + 2.0 * k.bx * h2;
+  double ddfy = 6.0 * k.ay * h3 + 2.0 * k.by * h2;
+  double dddfx = 6.0 * k.ax * h3;
+  double dddfy = 6.0 * k.ay * h3;
+  int i = 0;
+#ifdef BEZIER_X86_SIMD
+  // x and y share one register, halving the additions per point
+  __m128d f = _mm_set_pd(fy, fx);
+  __m128d df = _mm_set_pd(dfy, dfx);
+  __m128d ddf = _mm_set_pd(ddfy, ddfx);
+  __m128d dddf = _mm_set_pd(dddfy, dddfx);
+  for (; i < segments; ++i) {
+    _mm_storel_pd(outX + i, f);
+    _mm_storeh_pd(outY + i, f);
+    f = _mm_add_pd(f, df);
+    df = _mm_add_pd(df, ddf);
+    ddf = _mm_add_pd(ddf, dddf);
+  }
+#else
+  for (; i < segments; ++i) {
+    outX[i] = fx;
+    outY[i] = fy;
+    fx += dfx;
+    fy += dfy;
+    dfx += ddfx;
+    dfy += ddfy;
+    ddfx += dddfx;
+    ddfy += dddfy;
+  }
+#endif
+  outX[segments] = xs[3];
+  outY[segments] = ys[3];
+}
+
+// Returns the number of evenly spaced segments that keep the curve within
+// tolerance of its flattened polyline (Wang's formula for cubics).
+int CubicBezierSegments(const double *xs, const double *ys,
+                        double tolerance) {
+  double maxSecondDifference = 0.0;
+  for (int i = 0; i < 2; ++i) {
+    double ddx = xs[i] - 2.0 * xs[i + 1] + xs[i + 2];
+    double ddy = ys[i] - 2.0 * ys[i + 1] + ys[i + 2];
+    double length = sqrt(ddx * ddx + ddy * ddy);
+    if (isnan(length) || length > maxSecondDifference) {
+      maxSecondDifference = length;
+    }
+  }
+
+  // clamped before the cast, which is undefined for NaN and out-of-range
+  // values; a curve with NaN or huge control points gets the most segments
+  double n = ceil(sqrt(0.75 * maxSecondDifference / tolerance));
+  if (!(n <= MAX_CURVE_SEGMENTS)) {
+    return MAX_CURVE_SEGMENTS;
+  }
+  if (n < 1.0) {
+    return 1;
+  }
+
+  return (int) n;
+}
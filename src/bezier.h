@@ -0,0 +1,47 @@
+/*******************************************************************************
+   Filename: bezier.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for the batch cubic Bezier evaluation kernel shared by
+             curve tessellation, hit-testing and export.
+*******************************************************************************/
+
+#ifndef BEZIER_H_
+#define BEZIER_H_
+
+// Power-basis form of a cubic Bezier: B(t) = ((a * t + b) * t + c) * t + d.
+struct CubicCoefficients {
+  double ax, bx, cx, dx;
+  double ay, by, cy, dy;
+};
+
+// Ways EvaluateCubicBezier can evaluate a batch, fastest last.
+enum BezierKernel {
+  SCALAR_KERNEL,
+  SSE2_KERNEL,
+  AVX2_KERNEL,
+
+  NUM_BEZIER_KERNELS
+};
+
+const char *const BEZIER_KERNEL_NAMES[NUM_BEZIER_KERNELS] = {
+  "scalar", "sse2", "avx2"
+};
+
+void ComputeCubicCoefficients(const double *xs, const double *ys,
+                              CubicCoefficients *coefficients);
+void EvaluateCubicBezier(const double *xs, const double *ys,
+                         const double *ts, int n,
+                         double *outX, double *outY);
+bool EvaluateCubicBezierWith(BezierKernel kernel,
+                             const double *xs, const double *ys,
+                             const double *ts, int n,
+                             double *outX, double *outY);
+void EvaluateCubicBezierUniform(const double *xs, const double *ys,
+                                int segments,
+                                double *outX, double *outY);
+int CubicBezierSegments(const double *xs, const double *ys,
+                        double tolerance);
+
+#endif  // BEZIER_H_
@@ -7,16 +7,32 @@ Description: Main C++ file for "Draw," a simple drawing program for
              experimenting with OpenGL, Bezier curves, etc.
 *******************************************************************************/
 
+#include <chrono>
+#include <mutex>
 #include "draw.h"
 #include "shapes.h"
+#include "renderer.h"
+#include "backend.h"
+#include "text.h"
+#include "spatial.h"
+#include "benchmark.h"
+#include "journal.h"
+#include "raster.h"
+#include "savefile.h"
+#include "threadpool.h"
+#include "renderthread.h"
+#include "meshcache.h"
+#include "hud.h"
 
 double gScreenX = 900;
 double gScreenY = 600;
 bool gLeftDragging = false;
 bool gRightDragging = false;
 bool gPressingShift = false;
-Point2D *gSelectedPoint = NULL;
+Point2D *gSelectedPoint = NULL;  // a pending point being dragged
 Shape *gSelectedShape = NULL;
+int gSelectedShapeIndex = -1;  // the position of gSelectedShape in gShapes
+int gSelectedVertex = -1;  // the vertex of gSelectedShape being dragged
 
 vector<Point2D *> gPoints;
 vector<Shape *> gShapes;
@@ -25,11 +41,65 @@ vector<Label *> gLabels;
 ShapeType gShapeMode;
 double gRed, gGreen, gBlue;
 bool gFilled;
+RenderMode gRenderMode = IMMEDIATE_RENDERING;
+RenderBackend *gBackend = NULL;  // created on first use, for gRenderMode
+bool gRenderThread = true;  // rasterize software frames on their own thread
+HandleRenderer *gHandleRenderer = NULL;
+vector<GLfloat> gHandlePositions;
+LayerCache gPanelCache;
+LayerCache gFrameCache;  // the last frame drawn, for partial redraws
+PixelRect gDamage = {0, 0, 0, 0};  // changed since the last frame
+bool gDamageAll = true;
+GlyphAtlas gGlyphAtlas;
+SpatialIndex gSpatialIndex;
+bool gPanelDirty = true;
+double gFrameSeconds[NUM_RENDER_MODES];
+int gFrameCount[NUM_RENDER_MODES];
+double gCurveTolerance = DEFAULT_CURVE_TOLERANCE;
+SaveFormat gSaveFormat = TEXT_SAVE_FORMAT;
+BackgroundSaver gSaver;
+EditJournal gJournal;  // edits made since the drawing was last saved
+int gSaveCount = 0;  // saves requested, so a stale status reset can be ignored
+bool gPollingSave = false;
+FrameStats gFrameStats;
+FrameStats gLastFrameStats;
+FrameHud gHud;  // frame timing overlay, toggled with H
+
+// Motion events are coalesced and applied once per frame by FrameTick, which
+// runs at gFrameRate and posts a redisplay only if something has changed.
+// Unpaced, it only checks for frames finished by the render thread.
+bool gPaceFrames = true;
+int gFrameRate = DEFAULT_FRAME_RATE;
+chrono::steady_clock::time_point gNextFrame;
+bool gRedrawRequested = false;
+bool gMotionPending = false;
+int gMotionX, gMotionY;  // the latest position, in window coordinates
+bool gInputWaiting = false;  // input has arrived that no frame has shown
+chrono::steady_clock::time_point gInputTime;  // when the latest of it did
+InputStats gInputStats;
+
+// Unit-circle vertex tables, one per level of detail, built once on first use.
+struct CircleTable {
+  int segments;
+  double sagitta;  // max distance from a unit circle to the table's polygon
+  vector<double> cosines, sines;
+};
+vector<CircleTable> gCircleTables;
 
 //
 // Functions that draw basic primitives:
 //
 
+// Discards the errors left by earlier calls, so the next glGetError reports
+// only what follows. OpenGL may keep one flag per kind of error.
+void ClearGLErrors() {
+  for (int i = 0; i < MAX_PENDING_GL_ERRORS; ++i) {
+    if (glGetError() == GL_NO_ERROR) {
+      return;
+    }
+  }
+}
+
 void DrawRectangle(double x1, double y1, double x2, double y2) {
   glBegin(GL_QUADS);
   glVertex2d(x1, y1);
@@ -50,14 +120,14 @@ void DrawTriangle(double x1, double y1,
 }
 
 void DrawCircle(double x1, double y1, double radius) {
+  const double *cosines, *sines;
+  int n = GetUnitCircle(radius, &cosines, &sines);
   glBegin(GL_POLYGON);
-  for(int i = 0; i < CURVE_RESOLUTION; i++) {
-    double theta = (double) i / CURVE_RESOLUTION * 2.0 * PI;
-    double x = x1 + radius * cos(theta);
-    double y = y1 + radius * sin(theta);
-    glVertex2d(x, y);
+  for(int i = 0; i < n; i++) {
+    glVertex2d(x1 + radius * cosines[i], y1 + radius * sines[i]);
   }
   glEnd();
+  gFrameStats.curveVertices += n;
 }
 
 void DrawText(double x, double y, char *string) {
@@ -73,24 +143,244 @@ void DrawText(double x, double y, char *string) {
   glDisable(GL_BLEND);
 }
 
+// Draws a string from the glyph atlas, laying it out only if the cached
+// layout is stale. Falls back to bitmap characters until the atlas is built.
+void DrawText(double x, double y, const char *string, TextLayout *layout) {
+  if (!gGlyphAtlas.IsBuilt()) {
+    DrawText(x, y, (char *) string);
+    return;
+  }
+  if (!layout->valid) {
+    gGlyphAtlas.Layout(string, layout);
+  }
+  gGlyphAtlas.Draw(x, y, *layout);
+}
+
+//
+// Curve flattening functions:
+//
+
+// Builds unit-circle tables from MIN_CIRCLE_SEGMENTS to MAX_CURVE_SEGMENTS
+// sides, each level having roughly sqrt(2) times the sides of the last.
+void BuildCircleTables() {
+  gCircleTables.clear();
+  for (int n = MIN_CIRCLE_SEGMENTS, i = 0;
+       n <= MAX_CURVE_SEGMENTS;
+       n = (i % 2 == 0) ? n * 3 / 2 : n * 4 / 3, ++i) {
+    CircleTable table;
+    table.segments = n;
+    table.sagitta = 1.0 - cos(PI / n);
+    for (int j = 0; j < n; ++j) {
+      double theta = (double) j / n * 2.0 * PI;
+      table.cosines.push_back(cos(theta));
+      table.sines.push_back(sin(theta));
+    }
+    gCircleTables.push_back(table);
+  }
+}
+
+// Points cosines and sines at the coarsest unit-circle table that keeps a
+// circle of the given radius within the curve tolerance, returning its number
+// of vertices. A side spanning angle a deviates from the arc by
+// radius * (1 - cos(a / 2)).
+int GetUnitCircle(double radius, const double **cosines,
+                  const double **sines) {
+  static once_flag built;  // circles are tessellated on several threads
+  call_once(built, BuildCircleTables);
+  vector<CircleTable>::iterator iter = gCircleTables.begin();
+  while (iter + 1 < gCircleTables.end() &&
+         radius * iter->sagitta > gCurveTolerance) {
+    ++iter;
+  }
+  *cosines = &iter->cosines[0];
+  *sines = &iter->sines[0];
+
+  return iter->segments;
+}
+
+double GetCurveTolerance() {
+  return gCurveTolerance;
+}
+
+double SetCurveTolerance(double tolerance) {
+  if (tolerance < MIN_CURVE_TOLERANCE) {
+    tolerance = MIN_CURVE_TOLERANCE;
+  } else if (tolerance > MAX_CURVE_TOLERANCE) {
+    tolerance = MAX_CURVE_TOLERANCE;
+  }
+  gCurveTolerance = tolerance;
+
+  // every curve and circle needs re-flattening at the new tolerance
+  vector<Shape *>::iterator iter;
+  for (iter = gShapes.begin(); iter < gShapes.end(); ++iter) {
+    (*iter)->SetDirty(true);
+  }
+
+  return gCurveTolerance;
+}
+
+//
+// Functions that tessellate primitives for the retained-mode renderer:
+//
+
+void AppendVertex(vector<Vertex> *out, double x, double y,
+                  double r, double g, double b) {
+  Vertex v;
+  v.x = (GLfloat) x;
+  v.y = (GLfloat) y;
+  v.r = (GLubyte) (r < 0.0 ? 0 : r > 1.0 ? 255 : r * 255.0 + 0.5);
+  v.g = (GLubyte) (g < 0.0 ? 0 : g > 1.0 ? 255 : g * 255.0 + 0.5);
+  v.b = (GLubyte) (b < 0.0 ? 0 : b > 1.0 ? 255 : b * 255.0 + 0.5);
+  v.a = 255;
+  out->push_back(v);
+}
+
+// Filled polygons become a triangle fan (as GL_TRIANGLES), outlined polygons
+// become a closed loop of GL_LINES segments.
+void AppendPolygon(vector<Vertex> *out, const double *xs, const double *ys,
+                   int n, bool filled, double r, double g, double b) {
+  if (filled) {
+    for (int i = 1; i < n - 1; ++i) {
+      AppendVertex(out, xs[0], ys[0], r, g, b);
+      AppendVertex(out, xs[i], ys[i], r, g, b);
+      AppendVertex(out, xs[i + 1], ys[i + 1], r, g, b);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      AppendVertex(out, xs[i], ys[i], r, g, b);
+      AppendVertex(out, xs[(i + 1) % n], ys[(i + 1) % n], r, g, b);
+    }
+  }
+}
+
 //
 // GLUT callback functions:
 //
 
+// Redraws just the damaged part of the window when it can, restoring the rest
+// from the copy of the last frame: after a swap, the back buffer's contents
+// are undefined. A backend with a render thread is only handed the damage:
+// the window is redrawn in full around whatever frame it has finished.
 void display(void) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  gHud.StartFrame();
+  memset(&gFrameStats, 0, sizeof(gFrameStats));
+  if (gGlyphAtlas.NeedsBuild()) {
+    gGlyphAtlas.Build();
+  }
+  if (!gBackend) {
+    if (gRenderMode == SOFTWARE_RENDERING && gRenderThread) {
+      gBackend = new ThreadedBackend();
+    } else {
+      gBackend = CreateRenderBackend(gRenderMode);
+    }
+  }
+  bool threaded = dynamic_cast<ThreadedBackend *>(gBackend) != NULL;
+  if (gPanelDirty || !gPanelCache.IsValid()) {
+    DamageRect(0, 0, CONTROL_PANEL_WIDTH, gScreenY);
+  }
+  PixelRect clip = {max(gDamage.left, 0), max(gDamage.bottom, 0),
+                    min(gDamage.right, (int) gScreenX),
+                    min(gDamage.top, (int) gScreenY)};
+  bool damaged = clip.left < clip.right && clip.bottom < clip.top;
+  bool partial = !gDamageAll && (threaded || (gFrameCache.IsValid() &&
+                                              damaged));
+  if (!partial) {
+    clip.left = clip.bottom = 0;
+    clip.right = gScreenX;
+    clip.top = gScreenY;
+  } else if (threaded) {
+    if (!damaged) {
+      clip.left = clip.bottom = clip.right = clip.top = 0;
+    }
+  } else {
+    gFrameCache.Draw();
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(clip.left, clip.bottom, clip.right - clip.left,
+              clip.top - clip.bottom);
+  }
   glClear(GL_COLOR_BUFFER_BIT);
 
   // draw user-created shapes and points
+  gHud.StartStage();
+  gBackend->BeginFrame(gScreenX, gScreenY, 0.0, 0.0, 1.0,
+                       partial ? &clip : NULL);
+  gBackend->DrawShapes(gShapes);
+  gBackend->EndFrame();
+  gHud.EndStage(SHAPES_STAGE);
+  gFrameStats.shapesDrawn = gBackend->NumShapes();
+  gFrameStats.drawCalls = gBackend->NumDrawCalls();
+  gFrameStats.verticesDrawn = gBackend->NumVertices();
+  gFrameStats.shapesTessellated = gMeshCache.NumTessellated();
+  gFrameStats.curveVertices += gMeshCache.NumCurveVertices();
+  gFrameStats.tessellateSeconds = gMeshCache.GetSeconds();
+  gFrameStats.pixelsDrawn = (long) (clip.right - clip.left) *
+                            (clip.top - clip.bottom);
+
+  // draw the handles of selected shapes and pending points in one call
+  gHud.StartStage();
+  gHandlePositions.clear();
   vector<Shape *>::iterator shapeIter;
   for (shapeIter = gShapes.begin(); shapeIter < gShapes.end(); ++shapeIter) {
-    (*shapeIter)->Draw();
+    (*shapeIter)->AppendPoints(&gHandlePositions);
   }
   vector<Point2D *>::iterator pointIter;
   for (pointIter = gPoints.begin(); pointIter < gPoints.end(); ++pointIter) {
-    (*pointIter)->Draw();
+    gHandlePositions.push_back((GLfloat) (*pointIter)->GetX());
+    gHandlePositions.push_back((GLfloat) (*pointIter)->GetY());
+  }
+  if (!gHandleRenderer) {
+    gHandleRenderer = new HandleRenderer();
+  }
+  gHandleRenderer->Draw(gHandlePositions);
+  gHud.EndStage(POINTS_STAGE);
+
+  // draw control panel on left side of screen, re-rendering it only when
+  // something on it has changed
+  gHud.StartStage();
+  if (gPanelDirty || !gPanelCache.IsValid()) {
+    DrawControlPanel();
+    gPanelCache.Capture(0, 0, CONTROL_PANEL_WIDTH, gScreenY);
+    gPanelDirty = false;
+  } else {
+    gPanelCache.Draw();
   }
+  gHud.EndStage(PANEL_STAGE);
 
-  // draw control panel on left side of screen
+  if (threaded) {
+    gFrameCache.Invalidate();
+  } else if (partial) {
+    glDisable(GL_SCISSOR_TEST);
+    gFrameCache.Update(clip.left, clip.bottom, clip.right - clip.left,
+                       clip.top - clip.bottom);
+  } else {
+    gFrameCache.Capture(0, 0, gScreenX, gScreenY);
+  }
+  gDamage.left = gDamage.bottom = gDamage.right = gDamage.top = 0;
+  gDamageAll = false;
+
+  // the overlay is left out of the frame cache, so it is redrawn every frame
+  gHud.Draw(gFrameStats, gShapes.size(), RENDER_MODE_NAMES[gRenderMode],
+            gScreenX - HUD_MARGIN, gScreenY - HUD_MARGIN);
+  gHud.StartStage();
+  glutSwapBuffers();
+  gHud.EndStage(SWAP_STAGE);
+  gHud.EndFrame();
+  if (gInputWaiting) {
+    double latency = chrono::duration<double>(
+                       chrono::steady_clock::now() - gInputTime).count();
+    gInputStats.totalLatency += latency;
+    gInputStats.maxLatency = max(gInputStats.maxLatency, latency);
+    ++gInputStats.frames;
+    gInputWaiting = false;
+  }
+  gFrameSeconds[gRenderMode] += chrono::duration<double>(
+                                  chrono::steady_clock::now() - start).count();
+  ++gFrameCount[gRenderMode];
+  gLastFrameStats = gFrameStats;
+}
+
+void DrawControlPanel() {
   glColor3d(CONTROL_PANEL_RED, CONTROL_PANEL_GREEN, CONTROL_PANEL_BLUE);
   DrawRectangle(0, 0, CONTROL_PANEL_WIDTH, gScreenY);
   vector<Label *>::iterator labelIter;
@@ -103,8 +393,6 @@ void display(void) {
        ++buttonIter) {
     (*buttonIter)->Draw();
   }
-
-  glutSwapBuffers();
 }
 
 void keyboard(unsigned char c, int x, int y) {
@@ -136,17 +424,51 @@ void keyboard(unsigned char c, int x, int y) {
     case 'c':
       SetShapeMode(CIRCLE);
       break;
+    case 'V':
+    case 'v':
+      // the backends after SOFTWARE_RENDERING can't draw to the window
+      SetRenderMode((RenderMode) ((gRenderMode + 1) %
+                                  (SOFTWARE_RENDERING + 1)));
+      break;
+    case '[':
+      SetCurveTolerance(gCurveTolerance / 2.0);
+      cout << "curve tolerance: " << gCurveTolerance << " pixels" << endl;
+      break;
+    case ']':
+      SetCurveTolerance(gCurveTolerance * 2.0);
+      cout << "curve tolerance: " << gCurveTolerance << " pixels" << endl;
+      break;
+    case 'S':
+    case 's':
+      PrintFrameStats();
+      return;
+    case 'G':
+    case 'g':
+      CompareWithSoftware();
+      break;
+    case 'H':
+    case 'h':
+      gHud.SetShown(!gHud.IsShown());
+      break;
     default:
       return;
   }
 
-  glutPostRedisplay();
+  DamageAll();
+  RequestRedraw();
 }
 
 void reshape(int w, int h) {
+  // a glyph atlas that didn't fit (or failed) may bake in a larger window
+  if (w > gScreenX || h > gScreenY) {
+    gGlyphAtlas.AllowRetry();
+  }
+
   // reset global variables to the new width and height
   gScreenX = w;
   gScreenY = h;
+  gPanelDirty = true;
+  DamageAll();
 
   // set pixel resolution of final picture (screen coordinates)
   glViewport(0, 0, w, h);
@@ -159,6 +481,7 @@ void reshape(int w, int h) {
 }
 
 void mouse(int mouse_button, int state, int x, int y) {
+  FlushMotion();  // so a drag ends where the cursor last was
   y = gScreenY - y;
 
   // left mouse button
@@ -167,36 +490,7 @@ void mouse(int mouse_button, int state, int x, int y) {
     if (x > CONTROL_PANEL_WIDTH) {
       // if not dragging and a point's clicked, select it for dragging
       if (!gLeftDragging) {
-        vector<Point2D *>::iterator pointIter;
-        for (pointIter = gPoints.begin();
-        pointIter < gPoints.end();
-          ++pointIter) {
-          if ((*pointIter)->Contains(x, y)) {
-            gSelectedPoint = *pointIter;
-            gLeftDragging = true;
-            break;
-          }
-        }
-        if (!gLeftDragging) {
-          vector<Shape *>::iterator shapeIter;
-          for (shapeIter = gShapes.begin();
-          shapeIter < gShapes.end();
-            ++shapeIter) {
-            for (int i = 0; i < (*shapeIter)->NumPoints(); ++i) {
-              if ((*shapeIter)->GetPointAt(i)->Contains(x, y)) {
-                gSelectedPoint = (*shapeIter)->GetPointAt(i);
-                DeselectAllShapes();
-                gSelectedShape = *shapeIter;
-                gSelectedShape->SetSelected(true);
-                gLeftDragging = true;
-                break;
-              }
-            }
-            if (gLeftDragging) {
-              break;
-            }
-          }
-        }
+        gLeftDragging = SelectPointAt(x, y);
       }
       // if a point wasn't clicked, create a new point
       if (!gLeftDragging) {
@@ -204,56 +498,58 @@ void mouse(int mouse_button, int state, int x, int y) {
           DeselectAllShapes();
         }
         gPoints.push_back(new Point2D(x, y));
+        size_t numShapes = gShapes.size();
         switch (gShapeMode) {
         case LINE:
           if (gPoints.size() >= 2) {
             DeselectAllShapes();
-            gShapes.push_back(new Line(gPoints, gRed, gGreen, gBlue));
-            gPoints.clear();
+            AddShape(new Line(gPoints, gRed, gGreen, gBlue));
+            ClearPoints();
           }
           break;
         case BEZIER_CURVE:
           if (gPoints.size() >= 4) {
             DeselectAllShapes();
-            gShapes.push_back(new BezierCurve(gPoints, gRed, gGreen, gBlue));
-            gPoints.clear();
+            AddShape(new BezierCurve(gPoints, gRed, gGreen, gBlue));
+            ClearPoints();
           }
           break;
         case RECTANGLE:
           if (gPoints.size() >= 2) {
             DeselectAllShapes();
-            gShapes.push_back(new Rectangle(gPoints, gRed, gGreen, gBlue,
-                                            gFilled));
-            gPoints.clear();
+            AddShape(new Rectangle(gPoints, gRed, gGreen, gBlue, gFilled));
+            ClearPoints();
           }
           break;
         case TRIANGLE:
           if (gPoints.size() >= 3) {
             DeselectAllShapes();
-            gShapes.push_back(new Triangle(gPoints, gRed, gGreen, gBlue,
-                                           gFilled));
-            gPoints.clear();
+            AddShape(new Triangle(gPoints, gRed, gGreen, gBlue, gFilled));
+            ClearPoints();
           }
           break;
         case PENTAGON:
           if (gPoints.size() >= 5) {
             DeselectAllShapes();
-            gShapes.push_back(new Pentagon(gPoints, gRed, gGreen, gBlue,
-                                           gFilled));
-            gPoints.clear();
+            AddShape(new Pentagon(gPoints, gRed, gGreen, gBlue, gFilled));
+            ClearPoints();
           }
           break;
         case CIRCLE:
           if (gPoints.size() >= 2) {
             DeselectAllShapes();
-            gShapes.push_back(new Circle(gPoints, gRed, gGreen, gBlue,
-                                         gFilled));
-            gPoints.clear();
+            AddShape(new Circle(gPoints, gRed, gGreen, gBlue, gFilled));
+            ClearPoints();
           }
           break;
         default:
           break;
         }
+        if (gShapes.size() > numShapes) {
+          gJournal.RecordAddShape(gShapes.back());
+        } else {
+          gJournal.RecordAddPoint(x, y);
+        }
       }
     // left-click within control panel
     } else {
@@ -263,6 +559,7 @@ void mouse(int mouse_button, int state, int x, int y) {
            ++buttonIter) {
         if ((*buttonIter)->Contains(x, y)) {
           (*buttonIter)->SetPressed(true);
+          gPanelDirty = true;
           if ((*buttonIter)->IsButtonType(MODE_BUTTON)) {
             SetShapeMode((ShapeType) (*buttonIter)->GetAssociatedID());
           } else if ((*buttonIter)->IsButtonType(FILL_BUTTON)) {
@@ -292,130 +589,24 @@ void mouse(int mouse_button, int state, int x, int y) {
                 break;
               }
           } else if ((*buttonIter)->IsButtonType(SAVE_BUTTON)) {
-            ofstream fout("savefile");
-            vector<Shape *>::iterator shapeIter;
-            for (shapeIter = gShapes.begin();
-                 shapeIter < gShapes.end();
-                 ++shapeIter) {
-              fout << (*shapeIter)->GetShapeType() << " ";
-              for (int i = 0; i < (*shapeIter)->NumPoints(); ++i) {
-                fout << (*shapeIter)->GetPointAt(i)->GetX() << " ";
-                fout << (*shapeIter)->GetPointAt(i)->GetY() << " ";
-              }
-              fout << (*shapeIter)->GetRed() << " ";
-              fout << (*shapeIter)->GetGreen() << " ";
-              fout << (*shapeIter)->GetBlue() << " ";
-              fout << (*shapeIter)->IsFilled() << endl;
-            }
-            if (!gPoints.empty()) {
-              fout << NONE << " ";
-              vector<Point2D *>::iterator pointIter;
-              for (pointIter = gPoints.begin();
-                   pointIter < gPoints.end();
-                   ++pointIter) {
-                fout << (*pointIter)->GetX() << " ";
-                fout << (*pointIter)->GetY() << " ";
-              }
-              fout << endl;
-            }
-            fout.close();
+            SaveDrawing(SAVE_FILE_NAME);
           } else if ((*buttonIter)->IsButtonType(LOAD_BUTTON)) {
-            ifstream fin("savefile");
-
-            // clear canvas
-            if (fin.good()) {
-              gShapes.clear();
-              gPoints.clear();
-            }
-
-            // read input from save file
-            int currentShapeType;
-            double r, g, b;
-            bool filled;
-            char *line = NULL;
-            vector<double> input;
-            while (fin.good()) {
-              line = (char *) malloc((INPUT_STR_LEN + 1) * sizeof(char));
-              fin >> currentShapeType;
-              if (fin.good()) {
-                fin.getline(line, INPUT_STR_LEN);
-                line = strtok(line, " \n");
-                while (line) {
-                  input.push_back(atof(line));
-                  line = strtok(NULL, " \n");
-                }
-              }
-              if (fin.good()) {
-                vector<double>::iterator doubleIter;
-                for (doubleIter = input.begin();
-                     distance(doubleIter, input.end()) > 4;
-                     doubleIter += 2) {
-                  gPoints.push_back(new Point2D(*doubleIter,
-                                                *(doubleIter + 1)));
-                }
-                if (currentShapeType == NONE) {
-                  while (distance(doubleIter, input.end()) > 1) {
-                    gPoints.push_back(new Point2D(*doubleIter,
-                                                  *(doubleIter + 1)));
-                    doubleIter += 2;
-                  }
-                } else if (distance(doubleIter, input.end()) == 4) {
-                  r = *(doubleIter++);
-                  g = *(doubleIter++);
-                  b = *(doubleIter++);
-                  filled = *doubleIter;
-                } else {
-                  cerr << "Error: invalid data stored in save file." << endl;
-                  break;
-                }
-                input.clear();
-                switch(currentShapeType) {
-                  case LINE:
-                    gShapes.push_back(new Line(gPoints, r, g, b));
-                    gPoints.clear();
-                    break;
-                  case BEZIER_CURVE:
-                    gShapes.push_back(new BezierCurve(gPoints, r, g, b));
-                    gPoints.clear();
-                    break;
-                  case RECTANGLE:
-                    gShapes.push_back(new Rectangle(gPoints, r, g, b, filled));
-                    gPoints.clear();
-                    break;
-                  case TRIANGLE:
-                    gShapes.push_back(new Triangle(gPoints, r, g, b, filled));
-                    gPoints.clear();
-                    break;
-                  case PENTAGON:
-                    gShapes.push_back(new Pentagon(gPoints, r, g, b, filled));
-                    gPoints.clear();
-                    break;
-                  case CIRCLE:
-                    gShapes.push_back(new Circle(gPoints, r, g, b, filled));
-                    gPoints.clear();
-                    break;
-                  default:  // currentShapeType == NONE
-                    break;
-                }
-              }
-              if (line != NULL) {
-                free(line);
-                line = NULL;
-              }
-            }
-            if (line != NULL) {
-              free(line);
-            }
-            fin.close();
+            LoadDrawing(SAVE_FILE_NAME);
           } else if ((*buttonIter)->IsButtonType(UNDO_BUTTON)) {
             if (!gPoints.empty()) {
+              if (gSelectedPoint == gPoints.back()) {
+                gSelectedPoint = NULL;
+              }
+              delete gPoints.back();
               gPoints.pop_back();
+              gJournal.RecordRemoveLastPoint();
             } else if (!gShapes.empty()) {
-              gShapes.pop_back();
+              RemoveLastShape();
+              gJournal.RecordRemoveLastShape();
             }
           } else if ((*buttonIter)->IsButtonType(CLEAR_BUTTON)) {
-            gShapes.clear();
-            gPoints.clear();
+            ClearShapes();
+            gJournal.RecordClear();
           } else if ((*buttonIter)->IsButtonType(QUIT_BUTTON)) {
             exit(0);
           }
@@ -429,10 +620,12 @@ void mouse(int mouse_button, int state, int x, int y) {
   if (mouse_button == GLUT_LEFT_BUTTON && state == GLUT_UP) {
     gLeftDragging = false;
     gSelectedPoint = NULL;
+    gSelectedVertex = -1;
     vector<Button *>::iterator iter;
     for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
       if ((*iter)->IsPressed()) {
         (*iter)->SetPressed(false);
+        gPanelDirty = true;
       }
     }
   }
@@ -443,36 +636,7 @@ void mouse(int mouse_button, int state, int x, int y) {
     if (x > CONTROL_PANEL_WIDTH) {
       // if not dragging and a point's clicked, select it for dragging
       if (!gRightDragging) {
-        vector<Point2D *>::iterator pointIter;
-        for (pointIter = gPoints.begin();
-             pointIter < gPoints.end();
-             ++pointIter) {
-          if ((*pointIter)->Contains(x, y)) {
-            gSelectedPoint = (*pointIter);
-            gRightDragging = true;
-            break;
-          }
-        }
-        if (!gRightDragging) {
-          vector<Shape *>::iterator shapeIter;
-          for (shapeIter = gShapes.begin();
-               shapeIter < gShapes.end();
-               ++shapeIter) {
-            for (int i = 0; i < (*shapeIter)->NumPoints(); ++i) {
-              if ((*shapeIter)->GetPointAt(i)->Contains(x, y)) {
-                gSelectedPoint = (*shapeIter)->GetPointAt(i);
-                DeselectAllShapes();
-                gSelectedShape = (*shapeIter);
-                gSelectedShape->SetSelected(true);
-                gRightDragging = true;
-                break;
-              }
-            }
-            if (gRightDragging) {
-              break;
-            }
-          }
-        }
+        gRightDragging = SelectPointAt(x, y);
       }
     }
   }
@@ -481,10 +645,12 @@ void mouse(int mouse_button, int state, int x, int y) {
   if (mouse_button == GLUT_RIGHT_BUTTON && state == GLUT_UP) {
     gRightDragging = false;
     gSelectedPoint = NULL;
+    gSelectedVertex = -1;
     vector<Button *>::iterator iter;
     for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
       if ((*iter)->IsPressed()) {
         (*iter)->SetPressed(false);
+        gPanelDirty = true;
       }
     }
   }
@@ -493,29 +659,28 @@ void mouse(int mouse_button, int state, int x, int y) {
   if (mouse_button == GLUT_MIDDLE_BUTTON && state == GLUT_DOWN) {}
   if (mouse_button == GLUT_MIDDLE_BUTTON && state == GLUT_UP) {}
 
-  glutPostRedisplay();
+  // clicks are rare enough that tracking what each one changed isn't worth it
+  DamageAll();
+  RequestRedraw();
 }
 
+// Records where the cursor has been dragged. Only the latest position counts:
+// FrameTick applies it once per frame, however many events arrive between.
 void motion(int x, int y) {
   y = gScreenY - y;
-  if (gRightDragging) {
-    if (gSelectedShape) {
-      if (gSelectedPoint) {
-        gSelectedShape->Adjust(x, y, gSelectedPoint);
-      }
-    } else if (gSelectedPoint) {
-      gSelectedPoint->SetX(x);
-      gSelectedPoint->SetY(y);
-    }
-  } else if (gLeftDragging) {
-    if (gSelectedShape) {
-      gSelectedShape->Move(x, y, gSelectedPoint);
-    } else if (gSelectedPoint) {
-      gSelectedPoint->SetX(x);
-      gSelectedPoint->SetY(y);
-    }
+  if (!gRightDragging && !gLeftDragging) {
+    return;
+  }
+  ++gInputStats.events;
+  gInputWaiting = true;
+  gInputTime = chrono::steady_clock::now();
+  if (gPaceFrames) {
+    gMotionPending = true;
+    gMotionX = x;
+    gMotionY = y;
+  } else if (!ApplyMotion(x, y)) {
+    gInputWaiting = false;
   }
-  glutPostRedisplay();
 }
 
 void colorMenu(int id) {
@@ -540,23 +705,23 @@ void AddButton(const double x1, const double y1,
                const char * text,
                const int buttonType,
                const int associatedID) {
-  gPoints.clear();
+  ClearPoints();
   gPoints.push_back(new Point2D(x1, y1));
   gPoints.push_back(new Point2D(x2, y2));
   gButtons.push_back(new Button(gPoints, r, g, b, text, buttonType,
                                 associatedID));
-  gPoints.clear();
+  ClearPoints();
 }
 
 void AddSlider(const double x1, const double y1,
                const double x2, const double y2,
                const double r, const double g, const double b,
                const int associatedID) {
-  gPoints.clear();
+  ClearPoints();
   gPoints.push_back(new Point2D(x1, y1));
   gPoints.push_back(new Point2D(x2, y2));
   gButtons.push_back(new Slider(gPoints, r, g, b, associatedID));
-  gPoints.clear();
+  ClearPoints();
 
 }
 
@@ -564,18 +729,17 @@ void AddLabel(const double x1, const double y1,
               const double x2, const double y2,
               const double r, const double g, const double b,
               const char * text) {
-  gPoints.clear();
+  ClearPoints();
   gPoints.push_back(new Point2D(x1, y1));
   gPoints.push_back(new Point2D(x2, y2));
   gLabels.push_back(new Label(gPoints, r, g, b, text));
-  gPoints.clear();
+  ClearPoints();
 }
 
 void InitializeMyStuff() {
   int n = 1;  // serves as each button's y-offset multiplier
 
-  gShapes.clear();
-  gPoints.clear();
+  ClearShapes();
   gButtons.clear();
   gLabels.clear();
   gRed = DEFAULT_RED;
@@ -1060,6 +1224,7 @@ void InitializeMyStuff() {
 
 void SetFilled(bool b) {
   gFilled = b;
+  gPanelDirty = true;
   vector<Button *>::iterator iter;
   for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
     if ((*iter)->IsButtonType(FILL_BUTTON)) {
@@ -1082,12 +1247,11 @@ void SetColor(double r, double g, double b) {
   gRed = r;
   gGreen = g;
   gBlue = b;
+  gPanelDirty = true;
   vector<Button *>::iterator iter;
   for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
     if ((*iter)->IsButtonType(COLOR_BUTTON)) {
-      if ((*iter)->GetRed()   == r &&
-          (*iter)->GetGreen() == g &&
-          (*iter)->GetBlue()  == b) {
+      if ((*iter)->GetColor() == PackColor(r, g, b)) {
         (*iter)->SetSelected(true);
       } else {
         (*iter)->SetSelected(false);
@@ -1110,12 +1274,18 @@ void SetColor(double r, double g, double b) {
   }
   if (gSelectedShape) {
     gSelectedShape->SetColor(r, g, b);
+    gJournal.RecordSetColor(gSelectedShapeIndex,
+                            gSelectedShape->GetColor());
   }
 }
 
 ShapeType SetShapeMode(ShapeType m) {
   gShapeMode = m;
-  gPoints.clear();
+  gPanelDirty = true;
+  if (!gPoints.empty()) {
+    gJournal.RecordClearPoints();
+  }
+  ClearPoints();
   vector<Button *>::iterator iter;
   for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
     if ((*iter)->IsButtonType(MODE_BUTTON)) {
@@ -1130,6 +1300,434 @@ ShapeType SetShapeMode(ShapeType m) {
   return gShapeMode;
 }
 
+void PrintFrameStats() {
+  if (gFrameCount[gRenderMode] > 0) {
+    cout << RENDER_MODE_NAMES[gRenderMode] << " rendering: "
+         << gFrameCount[gRenderMode] << " frames, "
+         << 1000.0 * gFrameSeconds[gRenderMode] / gFrameCount[gRenderMode]
+         << " ms/frame average" << endl;
+  }
+  if (gBackend) {
+    cout << "drawn last frame: " << gBackend->NumRuns() << " runs, "
+         << gBackend->NumVertices() << " vertices" << endl;
+  }
+  ThreadedBackend *threaded = dynamic_cast<ThreadedBackend *>(gBackend);
+  const RenderedFrame *frame = threaded ? threaded->GetFrame() : NULL;
+  if (frame) {
+    cout << "render thread: " << frame->framesDrawn << " of "
+         << threaded->NumScenesPublished() << " snapshots drawn, "
+         << 1000.0 * frame->drawSeconds / frame->framesDrawn
+         << " ms/frame average" << endl;
+  }
+  if (gInputStats.frames > 0) {
+    cout << "dragging: " << gInputStats.events << " motion events, "
+         << gInputStats.edits << " applied, " << gInputStats.frames
+         << " frames; input to display "
+         << 1000.0 * gInputStats.totalLatency / gInputStats.frames
+         << " ms average, " << 1000.0 * gInputStats.maxLatency << " ms max"
+         << (gPaceFrames ? "" : " (unpaced)") << endl;
+  }
+  cout << "redrawn last frame: " << gLastFrameStats.shapesDrawn
+       << " shapes, " << gLastFrameStats.pixelsDrawn << " of "
+       << (long) gScreenX * (long) gScreenY << " pixels" << endl;
+  cout << "tessellated last frame: " << gLastFrameStats.shapesTessellated
+       << " shapes in " << 1000.0 * gLastFrameStats.tessellateSeconds
+       << " ms on " << GetThreadPool()->NumThreads() << " threads" << endl;
+  cout << "thread pool: " << GetThreadPool()->NumInlineLoops()
+       << " loops run on one thread because the pool was busy" << endl;
+  cout << "curve vertices emitted last frame: "
+       << gLastFrameStats.curveVertices << " (tolerance " << gCurveTolerance
+       << " pixels)" << endl;
+  cout << "document arena: " << gDocumentArena.LiveBytes() << " bytes live, "
+       << gDocumentArena.ReservedBytes() << " bytes reserved" << endl;
+}
+
+// Draws the shapes through the retained backend, reads the result back and
+// compares it with the software rasterizer's image of the same vertices. The
+// two can differ at edges and line ends (see raster.cc), so a pixel only
+// counts as mismatched when a channel is off by more than
+// COMPARE_CHANNEL_TOLERANCE, and the check passes while mismatched pixels
+// make up at most COMPARE_MAX_MISMATCH of the window. The back buffer is
+// overwritten, so the caller has to redraw the window afterward.
+bool CompareWithSoftware() {
+  int width = gScreenX, height = gScreenY;
+  RenderBackend *backend = CreateRenderBackend(RETAINED_RENDERING);
+  ClearGLErrors();
+  glDisable(GL_SCISSOR_TEST);
+  glClear(GL_COLOR_BUFFER_BIT);
+  backend->BeginFrame(width, height, 0.0, 0.0, 1.0);
+  backend->DrawShapes(gShapes);
+  backend->EndFrame();
+  delete backend;
+  vector<unsigned char> pixels(width * height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadBuffer(GL_BACK);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+  if (glGetError() != GL_NO_ERROR) {
+    cerr << "Error: couldn't read back the window." << endl;
+    return false;
+  }
+
+  vector<Vertex> vertices;
+  vector<DrawRun> runs;
+  TessellateShapes(gShapes, &vertices, &runs);
+  SoftwareRasterizer rasterizer(width, height);
+  rasterizer.Clear(RENDER_BACKGROUND, RENDER_BACKGROUND, RENDER_BACKGROUND);
+  rasterizer.Draw(vertices, runs);
+  const unsigned char *expected = rasterizer.GetPixels();
+
+  long mismatched = 0;
+  int worst = 0;
+  for (long i = 0; i < (long) width * height; ++i) {
+    int difference = 0;
+    for (int j = 0; j < 3; ++j) {
+      difference = max(difference, abs(pixels[i * 3 + j] -
+                                       expected[i * 3 + j]));
+    }
+    if (difference > COMPARE_CHANNEL_TOLERANCE) {
+      ++mismatched;
+    }
+    worst = max(worst, difference);
+  }
+  bool passed = mismatched <= COMPARE_MAX_MISMATCH * width * height;
+  cout << "retained vs software: " << mismatched << " of "
+       << (long) width * height << " pixels off by more than "
+       << COMPARE_CHANNEL_TOLERANCE << " levels (largest difference "
+       << worst << "), " << (passed ? "passed" : "FAILED") << endl;
+
+  return passed;
+}
+
+// Switches to another render backend, reporting the frame statistics of the
+// one being left. The new backend is created when the next frame is drawn.
+RenderMode SetRenderMode(RenderMode m) {
+  PrintFrameStats();
+  gRenderMode = m;
+  gFrameSeconds[m] = 0.0;
+  gFrameCount[m] = 0;
+  delete gBackend;
+  gBackend = NULL;
+  DamageAll();
+
+  return gRenderMode;
+}
+
+//
+// Functions that pace drawing:
+//
+
+// Moves whatever is being dragged to (x, y), damaging its old and new bounds
+// so only that part of the window is redrawn. Returns false if nothing is
+// being dragged.
+bool ApplyMotion(int x, int y) {
+  if (gSelectedShape && gSelectedVertex >= 0) {
+    DamageShape(gSelectedShape);
+    if (gRightDragging) {
+      gSelectedShape->Adjust(x, y, gSelectedVertex);
+      gJournal.RecordAdjustVertex(gSelectedShapeIndex,
+                                  gSelectedVertex, x, y,
+                                  gSelectedShape->IsAdjustAbsolute());
+    } else {
+      gSelectedShape->Move(x, y, gSelectedVertex);
+      gJournal.RecordMoveShape(gSelectedShapeIndex, gSelectedVertex, x, y);
+    }
+    gSpatialIndex.Update(gSelectedShape);
+    DamageShape(gSelectedShape);
+  } else if (gSelectedPoint) {
+    DamagePoint(gSelectedPoint->GetX(), gSelectedPoint->GetY());
+    gSelectedPoint->SetX(x);
+    gSelectedPoint->SetY(y);
+    gJournal.RecordMovePoint(GetPointIndex(gSelectedPoint), x, y);
+    DamagePoint(x, y);
+  } else {
+    return false;
+  }
+  ++gInputStats.edits;
+  RequestRedraw();
+
+  return true;
+}
+
+void FlushMotion() {
+  if (gMotionPending) {
+    gMotionPending = false;
+    if (!ApplyMotion(gMotionX, gMotionY)) {
+      gInputWaiting = false;
+    }
+  }
+}
+
+// Asks for a frame at the next tick, or at once if frames aren't paced.
+void RequestRedraw() {
+  if (gPaceFrames) {
+    gRedrawRequested = true;
+  } else {
+    glutPostRedisplay();
+  }
+}
+
+// Applies the latest motion and draws a frame if anything has changed or the
+// render thread has finished a frame to show, then schedules the next tick a
+// frame period after this one's deadline, so the rate holds however GLUT
+// rounds the delay. A tick that falls more than a period behind starts afresh
+// rather than bunching up to catch up.
+void FrameTick(int value) {
+  FlushMotion();
+  if (gRedrawRequested || (gBackend && gBackend->HasNewFrame())) {
+    gRedrawRequested = false;
+    glutPostRedisplay();
+  }
+
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  chrono::steady_clock::duration period = chrono::duration_cast<
+    chrono::steady_clock::duration>(chrono::duration<double>(1.0 /
+                                                             gFrameRate));
+  gNextFrame += period;
+  if (gNextFrame < now) {
+    gNextFrame = now + period;
+  }
+  int delay = chrono::duration_cast<chrono::milliseconds>(gNextFrame -
+                                                          now).count();
+  glutTimerFunc(delay, FrameTick, 0);
+}
+
+int SetFrameRate(int framesPerSecond) {
+  gFrameRate = max(MIN_FRAME_RATE, min(framesPerSecond, MAX_FRAME_RATE));
+
+  return gFrameRate;
+}
+
+//
+// Functions that track which part of the window needs redrawing:
+//
+
+void DamageAll() {
+  gDamageAll = true;
+}
+
+// Adds a box in window coordinates to the region redrawn by the next frame.
+void DamageRect(double left, double bottom, double right, double top) {
+  PixelRect rect = {(int) floor(left), (int) floor(bottom),
+                    (int) ceil(right), (int) ceil(top)};
+  if (rect.left >= rect.right || rect.bottom >= rect.top) {
+    return;
+  }
+  if (gDamage.left >= gDamage.right || gDamage.bottom >= gDamage.top) {
+    gDamage = rect;
+  } else {
+    gDamage.left = min(gDamage.left, rect.left);
+    gDamage.bottom = min(gDamage.bottom, rect.bottom);
+    gDamage.right = max(gDamage.right, rect.right);
+    gDamage.top = max(gDamage.top, rect.top);
+  }
+}
+
+// Damages a shape where it now stands, including its handles if selected.
+void DamageShape(const Shape *shape) {
+  double left, bottom, right, top;
+  shape->GetBounds(&left, &bottom, &right, &top);
+  double margin = POINT_RADIUS + SHAPE_BOUNDS_MARGIN;
+  DamageRect(left - margin, bottom - margin, right + margin, top + margin);
+}
+
+// Damages the handle of a pending point.
+void DamagePoint(double x, double y) {
+  double margin = POINT_RADIUS + SHAPE_BOUNDS_MARGIN;
+  DamageRect(x - margin, y - margin, x + margin, y + margin);
+}
+
+//
+// Functions that keep gShapes and the spatial index in step:
+//
+
+void AddShape(Shape *shape) {
+  gShapes.push_back(shape);
+  gSpatialIndex.Insert(shape);
+}
+
+void RemoveLastShape() {
+  if (gSelectedShape == gShapes.back()) {
+    gSelectedShape = NULL;
+    gSelectedShapeIndex = -1;
+    gSelectedVertex = -1;
+  }
+  gSpatialIndex.Remove(gShapes.back());
+  delete gShapes.back();
+  gShapes.pop_back();
+}
+
+// Drops every shape and pending point at once. They all live in the document
+// arena and scene store, so both are simply rewound; no shape is deleted one
+// at a time.
+void ClearShapes() {
+  gSelectedShape = NULL;
+  gSelectedShapeIndex = -1;
+  gSelectedVertex = -1;
+  gSelectedPoint = NULL;
+  gShapes.clear();
+  gPoints.clear();
+  gSpatialIndex.Clear();
+  gScene.Clear();
+  gMeshCache.Clear();
+  gDocumentArena.Reset();
+}
+
+// Returns the position of a shape in drawing order, searching from the top,
+// where edits mostly happen.
+int GetShapeIndex(const Shape *shape) {
+  for (int i = (int) gShapes.size() - 1; i >= 0; --i) {
+    if (gShapes[i] == shape) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int GetPointIndex(const Point2D *point) {
+  for (int i = 0; i < (int) gPoints.size(); ++i) {
+    if (gPoints[i] == point) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Discards the pending points of a shape still being placed.
+void ClearPoints() {
+  vector<Point2D *>::iterator iter;
+  for (iter = gPoints.begin(); iter < gPoints.end(); ++iter) {
+    if (*iter == gSelectedPoint) {
+      gSelectedPoint = NULL;
+    }
+    delete *iter;
+  }
+  gPoints.clear();
+}
+
+//
+// Save file functions:
+//
+
+// Saves on a background thread. If filename was the last file saved or loaded
+// and its journal is still short, only the edits made since then are appended
+// to the journal; otherwise the drawing is copied and the copy is written to
+// a temporary file that is renamed over filename, starting a new journal.
+// Returns at once; the Save button reports progress until the write finishes.
+bool SaveDrawing(const char *filename) {
+  if (gJournal.IsAttachedTo(filename) && !gJournal.NeedsCompaction()) {
+    gSaver.Append(filename, gJournal.TakeRecords());
+  } else {
+    SceneData *snapshot = new SceneData;
+    SnapshotScene(gShapes, gPoints, snapshot);
+    gSaver.Save(filename, gSaveFormat, snapshot);
+    gJournal.Attach(filename, 0);
+  }
+  ++gSaveCount;
+  SetSaveButtonText("Saving...");
+  if (!gPollingSave) {
+    gPollingSave = true;
+    glutTimerFunc(SAVE_POLL_MILLISECONDS, PollSaveStatus, 0);
+  }
+
+  return true;
+}
+
+// Checks on the background save from the GLUT thread, which owns the panel.
+void PollSaveStatus(int value) {
+  SaveStatus status = gSaver.GetStatus();
+  if (status == SAVE_IN_PROGRESS) {
+    glutTimerFunc(SAVE_POLL_MILLISECONDS, PollSaveStatus, 0);
+    return;
+  }
+  gPollingSave = false;
+  if (status == SAVE_FAILED) {
+    gJournal.Detach();  // the next save must rewrite the whole file
+  }
+  SetSaveButtonText(status == SAVE_SUCCEEDED ? "Saved" : "Save failed");
+  glutTimerFunc(SAVE_STATUS_MILLISECONDS, ResetSaveButton, gSaveCount);
+}
+
+void ResetSaveButton(int saveCount) {
+  if (saveCount == gSaveCount && !gPollingSave) {
+    SetSaveButtonText("Save");
+  }
+}
+
+void SetSaveButtonText(const char *text) {
+  vector<Button *>::iterator iter;
+  for (iter = gButtons.begin(); iter < gButtons.end(); ++iter) {
+    if ((*iter)->IsButtonType(SAVE_BUTTON)) {
+      (*iter)->SetText(text);
+    }
+  }
+  gPanelDirty = true;
+  RequestRedraw();
+}
+
+// Replaces the drawing with the contents of a save file of any format and
+// the edits in its journal. The whole file is read and checked before the
+// canvas is cleared, so it is left alone if the file can't be opened or
+// holds invalid data.
+bool LoadDrawing(const char *filename) {
+  gSaver.Wait();  // the file may be the one still being written
+  ifstream fin(filename);
+  if (!fin.good()) {
+    return false;
+  }
+  fin.close();
+  SceneData data;
+  if (!LoadSceneData(filename, &data)) {
+    cerr << "Error: invalid data stored in save file." << endl;
+    return false;
+  }
+  ClearShapes();
+  gScene.Reserve(data.types.size(), data.xs.size());
+  vector<Shape *> shapes;
+  bool loaded = BuildScene(data, &shapes, &gPoints);
+  int numRecords = loaded ? ReplayJournal(filename, &shapes, &gPoints) : -1;
+  if (numRecords >= 0) {
+    gJournal.Attach(filename, numRecords);
+  } else {
+    gJournal.Detach();
+  }
+  vector<Shape *>::iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    AddShape(*iter);
+  }
+
+  return loaded;
+}
+
+// Selects the control point under (x, y) for dragging, checking pending
+// points before the vertices of finished shapes. Returns false if none is
+// there.
+bool SelectPointAt(double x, double y) {
+  vector<Point2D *>::iterator pointIter;
+  for (pointIter = gPoints.begin(); pointIter < gPoints.end(); ++pointIter) {
+    if ((*pointIter)->Contains(x, y)) {
+      gSelectedPoint = *pointIter;
+      gSelectedVertex = -1;
+      return true;
+    }
+  }
+  Shape *shape;
+  int vertex;
+  if (gSpatialIndex.Pick(x, y, &shape, &vertex)) {
+    gSelectedPoint = NULL;
+    gSelectedVertex = vertex;
+    DeselectAllShapes();
+    gSelectedShape = shape;
+    // found once here, so no drag step has to search gShapes for it
+    gSelectedShapeIndex = GetShapeIndex(shape);
+    gSelectedShape->SetSelected(true);
+    return true;
+  }
+
+  return false;
+}
+
 void DeselectAllShapes() {
   vector<Shape *>::iterator iter;
   for (iter = gShapes.begin(); iter < gShapes.end(); ++iter) {
@@ -1138,7 +1736,103 @@ void DeselectAllShapes() {
 }
 
 int main(int argc, char **argv) {
+  RenderMode fileBackend = SOFTWARE_RENDERING;  // for --render
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      SetThreadCount(atoi(argv[i + 1]));
+    } else if (strcmp(argv[i], "--save-grid") == 0) {
+      SetSaveGrid(atof(argv[i + 1]));
+    } else if (strcmp(argv[i], "--backend") == 0) {
+      fileBackend = ParseRenderMode(argv[i + 1]);
+      if (fileBackend == NUM_RENDER_MODES) {
+        cerr << "Error: unknown render backend \"" << argv[i + 1] << "\"."
+             << endl;
+        return 1;
+      }
+    }
+  }
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--benchmark-picking") == 0) {
+      return RunPickingBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                                DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-loading") == 0) {
+      return RunLoadingBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                                DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-saving") == 0) {
+      return RunSavingBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                               DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-bezier") == 0) {
+      return RunBezierBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                               DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-raster") == 0) {
+      return RunRasterBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                               DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-tessellation") == 0) {
+      return RunTessellationBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                                     DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-backends") == 0) {
+      return RunBackendBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                                DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-damage") == 0) {
+      return RunDamageBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                               DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-drag") == 0) {
+      return RunDragBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                             DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--benchmark-render-thread") == 0) {
+      return RunRenderThreadBenchmark(i + 1 < argc ? atoi(argv[i + 1]) :
+                                                     DEFAULT_BENCHMARK_SHAPES);
+    } else if (strcmp(argv[i], "--render") == 0 && i + 3 < argc) {
+      return RenderSaveFiles(atoi(argv[i + 1]), atoi(argv[i + 2]),
+                             fileBackend, argc - (i + 3), argv + i + 3);
+    } else if (strcmp(argv[i], "--convert") == 0 && i + 2 < argc) {
+      SaveFormat format = NUM_SAVE_FORMATS;
+      if (i + 3 < argc && argv[i + 3][0] != '-') {
+        format = ParseSaveFormat(argv[i + 3]);
+        if (format == NUM_SAVE_FORMATS) {
+          cerr << "Error: unknown save format \"" << argv[i + 3] << "\"."
+               << endl;
+          return 1;
+        }
+      }
+      return ConvertSaveFile(argv[i + 1], argv[i + 2], format);
+    }
+  }
   glutInit(&argc, argv);
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--retained") == 0) {
+      gRenderMode = RETAINED_RENDERING;
+    } else if (strcmp(argv[i], "--immediate") == 0) {
+      gRenderMode = IMMEDIATE_RENDERING;
+    } else if (strcmp(argv[i], "--software") == 0) {
+      gRenderMode = SOFTWARE_RENDERING;
+    } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+      RenderMode mode = ParseRenderMode(argv[++i]);
+      if (mode > SOFTWARE_RENDERING) {
+        cerr << "Error: the " << argv[i] << " backend only works with "
+             << "--render." << endl;
+        return 1;
+      }
+      gRenderMode = mode;
+    } else if (strcmp(argv[i], "--frame-rate") == 0 && i + 1 < argc) {
+      SetFrameRate(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--no-frame-pacing") == 0) {
+      gPaceFrames = false;
+    } else if (strcmp(argv[i], "--no-render-thread") == 0) {
+      gRenderThread = false;
+    } else if (strcmp(argv[i], "--hud") == 0) {
+      gHud.SetShown(true);
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      SetCurveTolerance(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--save-format") == 0 && i + 1 < argc) {
+      SaveFormat format = ParseSaveFormat(argv[++i]);
+      if (format != NUM_SAVE_FORMATS) {
+        gSaveFormat = format;
+      } else {
+        cerr << "Error: unknown save format \"" << argv[i] << "\"." << endl;
+      }
+    }
+  }
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
   glutInitWindowSize(gScreenX, gScreenY);
   glutInitWindowPosition(50, 50);
@@ -1154,6 +1848,8 @@ int main(int argc, char **argv) {
   glutReshapeFunc(reshape);
   glutMouseFunc(mouse);
   glutMotionFunc(motion);
+  gNextFrame = chrono::steady_clock::now();
+  glutTimerFunc(0, FrameTick, 0);
   glClearColor(1, 1, 1, 0);  // background color
   InitializeMyStuff();
   glutMainLoop();
@@ -15,10 +15,14 @@ Description: Header file for "Draw," a simple drawing program for experimenting
 #include <cmath>
 #include <cstring>
 #include <vector>
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
 
 using namespace std;
 
+class Shape;
+class Point2D;
+
 const int INPUT_STR_LEN = 500;
 const int FILLED = 0;
 const int OUTLINED = 1;
@@ -73,17 +77,112 @@ const double DEFAULT_BUTTON_RED = 0.9;
 const double DEFAULT_BUTTON_GREEN = 0.9;
 const double DEFAULT_BUTTON_BLUE = 0.9;
 const double PI = atan(1.0) * 4.0;
-const int CURVE_RESOLUTION = 32;
+const double DEFAULT_CURVE_TOLERANCE = 0.25;  // max deviation in pixels
+const double MIN_CURVE_TOLERANCE = 0.01;
+const double MAX_CURVE_TOLERANCE = 16.0;
+const int MIN_CIRCLE_SEGMENTS = 8;
+const int MAX_CURVE_SEGMENTS = 1024;
+const int SAVE_POLL_MILLISECONDS = 50;
+const int SAVE_STATUS_MILLISECONDS = 2000;  // how long "Saved" stays up
+const int DEFAULT_FRAME_RATE = 60;  // frames per second at most
+const int MIN_FRAME_RATE = 1;
+const int MAX_FRAME_RATE = 1000;
+const int MAX_PENDING_GL_ERRORS = 16;  // at least one per kind of error
+const int COMPARE_CHANNEL_TOLERANCE = 2;  // levels per channel, 0-255
+const double COMPARE_MAX_MISMATCH = 0.01;  // fraction of the window's pixels
+
+// The render backends (see backend.h), in the order 'V' cycles through them.
+enum RenderMode {
+  IMMEDIATE_RENDERING,  // each vertex is passed to OpenGL by its own call
+  RETAINED_RENDERING,   // shapes are packed into vertex buffers
+  SOFTWARE_RENDERING,   // shapes are rasterized on the CPU, then blitted
+  SVG_RENDERING,        // shapes are written to an SVG file (--render only)
+
+  NUM_RENDER_MODES
+};
+
+// Drawing statistics, reset at the start of every frame.
+struct FrameStats {
+  int curveVertices;  // vertices emitted by curve and circle flattening
+  int shapesDrawn;    // shapes overlapping the redrawn region
+  long pixelsDrawn;   // pixels in the redrawn region
+  int shapesTessellated;     // new or dirty shapes given new meshes
+  double tessellateSeconds;  // spent doing so, across the thread pool
+  int drawCalls;      // issued by the render backend
+  int verticesDrawn;  // submitted by the render backend
+};
+
+// Drag responsiveness, accumulated since startup.
+struct InputStats {
+  long events;    // motion events received while dragging
+  long edits;     // positions actually applied to a shape or point
+  long frames;    // frames that showed new input
+  double totalLatency, maxLatency;  // seconds from the latest input to swap
+};
 
+// A rectangle of pixels, exclusive of right and top.
+struct PixelRect {
+  int left, bottom, right, top;
+};
+
+// A string laid out as textured quads, cached until the string changes.
+struct TextLayout {
+  vector<GLfloat> vertices;  // (x, y, s, t) relative to the string's origin
+  bool valid;
+};
+
+// Interleaved vertex format used by the retained-mode renderer.
+struct Vertex {
+  GLfloat x, y;
+  GLubyte r, g, b, a;
+};
+
+void ClearGLErrors();
 void DrawRectangle(double x1, double y1, double x2, double y2);
 void DrawTriangle(double x1, double y1,
                   double x2, double y2,
                   double x3, double y3);
 void DrawCircle(double x1, double y1, double radius);
 void DrawText(double x, double y, char *string);
+void DrawText(double x, double y, const char *string, TextLayout *layout);
+int GetUnitCircle(double radius, const double **cosines,
+                  const double **sines);
+double GetCurveTolerance();
+double SetCurveTolerance(double tolerance);
+void AppendVertex(vector<Vertex> *out, double x, double y,
+                  double r, double g, double b);
+void AppendPolygon(vector<Vertex> *out, const double *xs, const double *ys,
+                   int n, bool filled, double r, double g, double b);
+void DrawControlPanel();
 void SetColor(double r, double g, double b);
 ShapeType SetShapeMode(ShapeType m);
+RenderMode SetRenderMode(RenderMode m);
+void PrintFrameStats();
+bool CompareWithSoftware();
 void SetFilled(bool b);
+void AddShape(Shape *shape);
+void RemoveLastShape();
+void ClearShapes();
+void ClearPoints();
+int GetShapeIndex(const Shape *shape);
+int GetPointIndex(const Point2D *point);
+bool SaveDrawing(const char *filename);
+void PollSaveStatus(int value);
+void ResetSaveButton(int saveCount);
+void SetSaveButtonText(const char *text);
+bool ApplyMotion(int x, int y);
+void FlushMotion();
+void RequestRedraw();
+void FrameTick(int value);
+int SetFrameRate(int framesPerSecond);
+void DamageAll();
+void DamageRect(double left, double bottom, double right, double top);
+void DamageShape(const Shape *shape);
+void DamagePoint(double x, double y);
+bool LoadDrawing(const char *filename);
 void DeselectAllShapes();
+bool SelectPointAt(double x, double y);
+
+extern FrameStats gFrameStats;
 
 #endif  // DRAW_H_
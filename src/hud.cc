@@ -0,0 +1,136 @@
+/*******************************************************************************
+   Filename: hud.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for FrameHud. The overlay is drawn before the
+             buffers are swapped, so the frame time and swap time it shows
+             are the previous frame's; the other stages are the current
+             frame's.
+*******************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <malloc.h>
+#include "hud.h"
+#include "arena.h"
+#include "text.h"
+
+FrameHud::FrameHud() {
+  mShown = false;
+  mNextFrame = 0;
+  mLastFrameSeconds = 0.0;
+  memset(mStageSeconds, 0, sizeof(mStageSeconds));
+  for (int i = 0; i < HUD_LINES; ++i) {
+    mLines[i][0] = '\0';
+    mLayouts[i].valid = false;
+  }
+}
+
+// Shows or hides the overlay. Timing starts afresh whenever it is shown.
+bool FrameHud::SetShown(bool shown) {
+  mShown = shown;
+  mHistory.clear();
+  mNextFrame = 0;
+  mLastFrameSeconds = 0.0;
+  memset(mStageSeconds, 0, sizeof(mStageSeconds));
+
+  return mShown;
+}
+
+// Records the time since StartFrame as the frame's time.
+void FrameHud::EndFrame() {
+  if (!mShown) {
+    return;
+  }
+  mLastFrameSeconds = chrono::duration<double>(Clock::now() -
+                                               mFrameStart).count();
+  if ((int) mHistory.size() < HUD_HISTORY_FRAMES) {
+    mHistory.push_back(mLastFrameSeconds);
+  } else {
+    mHistory[mNextFrame] = mLastFrameSeconds;
+  }
+  mNextFrame = (mNextFrame + 1) % HUD_HISTORY_FRAMES;
+}
+
+// The nearest-rank percentile of sorted, a fraction from 0 to 1.
+static double Percentile(const vector<double> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  int rank = (int) ceil(fraction * sorted.size()) - 1;
+
+  return sorted[max(0, min(rank, (int) sorted.size() - 1))];
+}
+
+// Draws the overlay with its top right corner at (right, top), given what
+// the canvas stage drew and the name of the backend that drew it.
+void FrameHud::Draw(const FrameStats &stats, int numShapes,
+                    const char *backend, double right, double top) {
+  if (!mShown) {
+    return;
+  }
+  double total = 0.0;
+  vector<double>::iterator iter;
+  for (iter = mHistory.begin(); iter < mHistory.end(); ++iter) {
+    total += *iter;
+  }
+  mSorted = mHistory;
+  sort(mSorted.begin(), mSorted.end());
+
+  char lines[HUD_LINES][HUD_TEXT_MAX_LEN];
+  snprintf(lines[0], HUD_TEXT_MAX_LEN, "frame %.2f ms, %.2f ms avg of %d",
+           1000.0 * mLastFrameSeconds,
+           1000.0 * total / max((int) mHistory.size(), 1),
+           (int) mHistory.size());
+  snprintf(lines[1], HUD_TEXT_MAX_LEN, "p50 %.2f  p90 %.2f  p99 %.2f ms",
+           1000.0 * Percentile(mSorted, 0.5),
+           1000.0 * Percentile(mSorted, 0.9),
+           1000.0 * Percentile(mSorted, 0.99));
+  snprintf(lines[2], HUD_TEXT_MAX_LEN, "%s %.2f  %s %.2f ms",
+           FRAME_STAGE_NAMES[SHAPES_STAGE],
+           1000.0 * mStageSeconds[SHAPES_STAGE],
+           FRAME_STAGE_NAMES[POINTS_STAGE],
+           1000.0 * mStageSeconds[POINTS_STAGE]);
+  snprintf(lines[3], HUD_TEXT_MAX_LEN, "%s %.2f  %s %.2f ms",
+           FRAME_STAGE_NAMES[PANEL_STAGE],
+           1000.0 * mStageSeconds[PANEL_STAGE],
+           FRAME_STAGE_NAMES[SWAP_STAGE],
+           1000.0 * mStageSeconds[SWAP_STAGE]);
+  snprintf(lines[4], HUD_TEXT_MAX_LEN, "%s: %d draw calls, %d vertices",
+           backend, stats.drawCalls, stats.verticesDrawn);
+  snprintf(lines[5], HUD_TEXT_MAX_LEN,
+           "shapes: %d drawn, %d culled, %d tessellated",
+           stats.shapesDrawn, max(numShapes - stats.shapesDrawn, 0),
+           stats.shapesTessellated);
+  snprintf(lines[6], HUD_TEXT_MAX_LEN, "heap %.1f MB, document %.1f MB",
+           GetHeapBytes() / 1048576.0,
+           gDocumentArena.LiveBytes() / 1048576.0);
+
+  double left = right - HUD_WIDTH;
+  double bottom = top - HUD_LINES * HUD_LINE_HEIGHT - 2.0 * HUD_MARGIN;
+  glColor3d(0.9, 0.9, 0.9);
+  DrawRectangle(left, bottom, right, top);
+  glColor3d(0, 0, 0);
+  for (int i = 0; i < HUD_LINES; ++i) {
+    if (strcmp(lines[i], mLines[i]) != 0) {
+      strcpy(mLines[i], lines[i]);
+      mLayouts[i].valid = false;
+    }
+    DrawText(left + HUD_MARGIN,
+             top - HUD_MARGIN - (i + 1) * HUD_LINE_HEIGHT + GLYPH_DESCENT,
+             mLines[i], &mLayouts[i]);
+  }
+}
+
+// Bytes of the C++ heap in use, including blocks too large for its arenas.
+// Zero where the C library can't say.
+size_t FrameHud::GetHeapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
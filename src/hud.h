@@ -0,0 +1,78 @@
+/*******************************************************************************
+   Filename: hud.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for FrameHud, an overlay in the corner of the window
+             showing where frame time goes: the last, average and percentile
+             frame times over recent frames, the time spent in each stage of
+             display(), what the canvas stage drew and how much memory is in
+             use. While the overlay is hidden, frames aren't timed at all.
+*******************************************************************************/
+
+#ifndef HUD_H_
+#define HUD_H_
+
+#include <chrono>
+#include "draw.h"
+
+enum FrameStage {
+  SHAPES_STAGE,  // the canvas, through the render backend
+  POINTS_STAGE,  // handles of selected shapes and pending points
+  PANEL_STAGE,   // the control panel
+  SWAP_STAGE,    // glutSwapBuffers
+
+  NUM_FRAME_STAGES
+};
+
+const char *const FRAME_STAGE_NAMES[NUM_FRAME_STAGES] = {
+  "shapes", "points", "panel", "swap"
+};
+
+const int HUD_HISTORY_FRAMES = 240;  // behind the average and percentiles
+const int HUD_LINES = 7;
+const int HUD_TEXT_MAX_LEN = 64;
+const double HUD_WIDTH = 440.0;  // room for 48 characters
+const double HUD_LINE_HEIGHT = 16.0;
+const double HUD_MARGIN = 8.0;
+
+class FrameHud {
+ public:
+  FrameHud();
+  bool SetShown(bool shown);
+  bool IsShown() const { return mShown; }
+  void StartFrame() {
+    if (mShown) {
+      mFrameStart = mStageStart = Clock::now();
+    }
+  }
+  void StartStage() {
+    if (mShown) {
+      mStageStart = Clock::now();
+    }
+  }
+  void EndStage(FrameStage stage) {
+    if (mShown) {
+      mStageSeconds[stage] = chrono::duration<double>(Clock::now() -
+                                                      mStageStart).count();
+    }
+  }
+  void EndFrame();
+  void Draw(const FrameStats &stats, int numShapes, const char *backend,
+            double right, double top);
+ private:
+  typedef chrono::steady_clock Clock;
+  static size_t GetHeapBytes();
+
+  bool mShown;
+  Clock::time_point mFrameStart, mStageStart;
+  double mStageSeconds[NUM_FRAME_STAGES];  // the swap is the last frame's
+  vector<double> mHistory;  // frame times, oldest overwritten first
+  int mNextFrame;           // where the next frame time goes in mHistory
+  double mLastFrameSeconds;
+  vector<double> mSorted;   // scratch space for the percentiles
+  char mLines[HUD_LINES][HUD_TEXT_MAX_LEN];  // the text last drawn
+  TextLayout mLayouts[HUD_LINES];            // laid out again when it changes
+};
+
+#endif  // HUD_H_
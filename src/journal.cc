@@ -0,0 +1,478 @@
+/*******************************************************************************
+   Filename: journal.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for EditJournal and functions that write and
+             replay journal files. A journal's header records the device,
+             inode, size and modification time of its save file; rewriting
+             the save file (which always goes through a rename) changes them,
+             so a journal left over from an older save is never replayed.
+*******************************************************************************/
+
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "journal.h"
+#include "savefile.h"
+
+EditJournal::EditJournal() {
+  Detach();
+}
+
+// Starts following a save file whose journal already holds numRecords edits.
+void EditJournal::Attach(const char *filename, int numRecords) {
+  mFilename = filename;
+  mRecords.clear();
+  mNumSaved = numRecords;
+  mNumRecords = 0;
+  mLastOp = 0;
+}
+
+// Stops following any save file, so the next save must write everything.
+void EditJournal::Detach() {
+  mFilename.clear();
+  mRecords.clear();
+  mNumSaved = 0;
+  mNumRecords = 0;
+  mLastOp = 0;
+}
+
+bool EditJournal::IsAttachedTo(const char *filename) const {
+  return !mFilename.empty() && mFilename == filename;
+}
+
+// Reports whether the journal file has grown long enough that replaying it
+// would cost more than rewriting the save file.
+bool EditJournal::NeedsCompaction() const {
+  return mNumSaved + mNumRecords >= JOURNAL_COMPACT_RECORDS;
+}
+
+// Hands over the records made since the last call, counting them as saved.
+string EditJournal::TakeRecords() {
+  string records;
+  records.swap(mRecords);
+  mNumSaved += mNumRecords;
+  mNumRecords = 0;
+  mLastOp = 0;
+
+  return records;
+}
+
+void EditJournal::RecordAddShape(const Shape *shape) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(ADD_SHAPE_OP, -1, -1);
+  mRecords += ' ';
+  AppendNumber(shape->GetShapeType());
+  mRecords += ' ';
+  AppendNumber(shape->NumPoints());
+  for (int i = 0; i < shape->NumPoints(); ++i) {
+    mRecords += ' ';
+    AppendNumber(shape->GetX(i));
+    mRecords += ' ';
+    AppendNumber(shape->GetY(i));
+  }
+  mRecords += ' ';
+  AppendNumber(shape->GetColor());
+  mRecords += ' ';
+  AppendNumber(shape->IsFilled());
+  mRecords += '\n';
+}
+
+// Unless absolute (see Shape::IsAdjustAbsolute), every adjustment is kept,
+// since replaying only the last wouldn't end where the drag did.
+void EditJournal::RecordAdjustVertex(int shape, int vertex,
+                                     double x, double y, bool absolute) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(ADJUST_VERTEX_OP, shape, vertex, absolute);
+  mRecords += ' ';
+  AppendNumber(shape);
+  mRecords += ' ';
+  AppendNumber(vertex);
+  mRecords += ' ';
+  AppendNumber(x);
+  mRecords += ' ';
+  AppendNumber(y);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordMoveShape(int shape, int vertex, double x, double y) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(MOVE_SHAPE_OP, shape, vertex);
+  mRecords += ' ';
+  AppendNumber(shape);
+  mRecords += ' ';
+  AppendNumber(vertex);
+  mRecords += ' ';
+  AppendNumber(x);
+  mRecords += ' ';
+  AppendNumber(y);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordSetColor(int shape, PackedColor color) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(SET_COLOR_OP, shape, -1);
+  mRecords += ' ';
+  AppendNumber(shape);
+  mRecords += ' ';
+  AppendNumber(color);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordRemoveLastShape() {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(REMOVE_LAST_SHAPE_OP, -1, -1);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordAddPoint(double x, double y) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(ADD_POINT_OP, -1, -1);
+  mRecords += ' ';
+  AppendNumber(x);
+  mRecords += ' ';
+  AppendNumber(y);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordMovePoint(int point, double x, double y) {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(MOVE_POINT_OP, point, -1);
+  mRecords += ' ';
+  AppendNumber(point);
+  mRecords += ' ';
+  AppendNumber(x);
+  mRecords += ' ';
+  AppendNumber(y);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordRemoveLastPoint() {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(REMOVE_LAST_POINT_OP, -1, -1);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordClearPoints() {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(CLEAR_POINTS_OP, -1, -1);
+  mRecords += '\n';
+}
+
+void EditJournal::RecordClear() {
+  if (!IsRecording()) {
+    return;
+  }
+  BeginRecord(CLEAR_OP, -1, -1);
+  mRecords += '\n';
+}
+
+// Starts a new record. Adjusting, moving and recoloring set absolute values,
+// so a run of them aimed at the same target (one per motion event during a
+// drag) collapses into the last: the previous record is simply overwritten.
+// A record that isn't mergeable is never overwritten and ends any such run.
+void EditJournal::BeginRecord(JournalOp op, int index, int vertex,
+                              bool mergeable) {
+  bool absolute = mergeable &&
+                  (op == ADJUST_VERTEX_OP || op == MOVE_SHAPE_OP ||
+                   op == SET_COLOR_OP || op == MOVE_POINT_OP);
+  if (absolute && op == mLastOp && index == mLastIndex &&
+      vertex == mLastVertex) {
+    mRecords.resize(mLastRecordStart);
+  } else {
+    mLastRecordStart = mRecords.size();
+    ++mNumRecords;
+  }
+  mLastOp = absolute ? op : 0;
+  mLastIndex = index;
+  mLastVertex = vertex;
+  mRecords += (char) op;
+}
+
+// Writes the shortest text that reads back as exactly the same double.
+void EditJournal::AppendNumber(double value) {
+  char buffer[32];
+  to_chars_result result = to_chars(buffer, buffer + sizeof(buffer), value);
+  mRecords.append(buffer, result.ptr);
+}
+
+//
+// Journal files:
+//
+
+string GetJournalFilename(const char *filename) {
+  return string(filename) + JOURNAL_SUFFIX;
+}
+
+static bool GetSaveFileIdentity(const char *filename, string *identity) {
+  struct stat info;
+  if (stat(filename, &info) != 0) {
+    return false;
+  }
+  char buffer[160];
+  snprintf(buffer, sizeof(buffer), "%s %d %llu %llu %lld %lld %ld",
+           JOURNAL_MAGIC, JOURNAL_VERSION,
+           (unsigned long long) info.st_dev, (unsigned long long) info.st_ino,
+           (long long) info.st_size, (long long) info.st_mtim.tv_sec,
+           (long) info.st_mtim.tv_nsec);
+  *identity = buffer;
+
+  return true;
+}
+
+// Starts an empty journal for a save file that has just been written in full.
+bool WriteJournalHeader(const char *filename) {
+  string header;
+  if (!GetSaveFileIdentity(filename, &header)) {
+    return false;
+  }
+  header += '\n';
+  string journal = GetJournalFilename(filename);
+  string temp = journal + ".tmp";
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cerr << "Error: unable to write " << temp << "." << endl;
+    return false;
+  }
+  bool written = write(fd, header.data(), header.size()) ==
+                 (ssize_t) header.size() && fsync(fd) == 0;
+  close(fd);
+  if (!written || rename(temp.c_str(), journal.c_str()) != 0) {
+    cerr << "Error: unable to write " << journal << "." << endl;
+    unlink(temp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// Adds records to the end of a save file's journal and flushes them to disk.
+bool AppendJournal(const char *filename, const string &records) {
+  string journal = GetJournalFilename(filename);
+  int fd = open(journal.c_str(), O_WRONLY | O_APPEND);
+  if (fd < 0) {
+    cerr << "Error: unable to open " << journal << "." << endl;
+    return false;
+  }
+  const char *p = records.data();
+  size_t remaining = records.size();
+  while (remaining > 0) {
+    ssize_t written = write(fd, p, remaining);
+    if (written <= 0) {
+      break;
+    }
+    p += written;
+    remaining -= written;
+  }
+  bool appended = remaining == 0 && fdatasync(fd) == 0;
+  close(fd);
+  if (!appended) {
+    cerr << "Error: unable to append to " << journal << "." << endl;
+  }
+
+  return appended;
+}
+
+// Parses the numbers after a record's op character, up to the end of the line.
+// Infinities and NaNs are never written, so they mark a damaged record.
+static bool ParseRecord(const char *p, const char *end,
+                        vector<double> *numbers) {
+  numbers->clear();
+  while (p < end) {
+    if (*p == ' ') {
+      ++p;
+      continue;
+    }
+    double value;
+    from_chars_result result = from_chars(p, end, value);
+    if (result.ec != errc() || !isfinite(value)) {
+      return false;
+    }
+    numbers->push_back(value);
+    p = result.ptr;
+  }
+
+  return true;
+}
+
+static void DeletePoints(vector<Point2D *> *points) {
+  vector<Point2D *>::iterator iter;
+  for (iter = points->begin(); iter < points->end(); ++iter) {
+    delete *iter;
+  }
+  points->clear();
+}
+
+// Whether a number read from a record can stand for a count, index or color
+// from low to high, so that casting it is safe.
+static bool IsWholeNumber(double value, double low, double high) {
+  return value == floor(value) && value >= low && value <= high;
+}
+
+// Applies one record to a drawing, returning false if it doesn't make sense
+// there (which means the journal is damaged).
+static bool ApplyRecord(char op, const vector<double> &numbers,
+                        vector<Shape *> *shapes, vector<Point2D *> *points) {
+  int n = numbers.size();
+  int index = n > 0 && IsWholeNumber(numbers[0], 0, INT_MAX) ?
+              (int) numbers[0] : -1;
+  switch (op) {
+    case ADD_SHAPE_OP: {
+      if (n < 4 || !IsWholeNumber(numbers[1], 0, n) ||
+          n != 2 * (int) numbers[1] + 4 ||
+          !IsWholeNumber(numbers[n - 2], 0, UINT_MAX)) {
+        return false;
+      }
+      vector<Point2D> scratch;
+      vector<Point2D *> vertices;
+      scratch.reserve((n - 4) / 2);
+      for (int i = 2; i < n - 2; i += 2) {
+        scratch.push_back(Point2D(numbers[i], numbers[i + 1]));
+        vertices.push_back(&scratch.back());
+      }
+      PackedColor color = (PackedColor) numbers[n - 2];
+      Shape *shape = CreateShape((ShapeType) index, vertices,
+                                 UnpackRed(color), UnpackGreen(color),
+                                 UnpackBlue(color), numbers[n - 1] != 0.0);
+      if (!shape) {
+        return false;
+      }
+      shapes->push_back(shape);
+      DeletePoints(points);  // they were used up making the shape
+      return true;
+    }
+    case ADJUST_VERTEX_OP:
+    case MOVE_SHAPE_OP:
+      if (n != 4 || index < 0 || index >= (int) shapes->size() ||
+          !IsWholeNumber(numbers[1], 0,
+                         (*shapes)[index]->NumPoints() - 1)) {
+        return false;
+      }
+      if (op == ADJUST_VERTEX_OP) {
+        (*shapes)[index]->Adjust(numbers[2], numbers[3], (int) numbers[1]);
+      } else {
+        (*shapes)[index]->Move(numbers[2], numbers[3], (int) numbers[1]);
+      }
+      return true;
+    case SET_COLOR_OP:
+      if (n != 2 || index < 0 || index >= (int) shapes->size() ||
+          !IsWholeNumber(numbers[1], 0, UINT_MAX)) {
+        return false;
+      }
+      (*shapes)[index]->SetColor(UnpackRed((PackedColor) numbers[1]),
+                                 UnpackGreen((PackedColor) numbers[1]),
+                                 UnpackBlue((PackedColor) numbers[1]));
+      return true;
+    case REMOVE_LAST_SHAPE_OP:
+      if (shapes->empty()) {
+        return false;
+      }
+      delete shapes->back();
+      shapes->pop_back();
+      return true;
+    case ADD_POINT_OP:
+      if (n != 2) {
+        return false;
+      }
+      points->push_back(new Point2D(numbers[0], numbers[1]));
+      return true;
+    case MOVE_POINT_OP:
+      if (n != 3 || index < 0 || index >= (int) points->size()) {
+        return false;
+      }
+      (*points)[index]->SetX(numbers[1]);
+      (*points)[index]->SetY(numbers[2]);
+      return true;
+    case REMOVE_LAST_POINT_OP:
+      if (points->empty()) {
+        return false;
+      }
+      delete points->back();
+      points->pop_back();
+      return true;
+    case CLEAR_POINTS_OP:
+      DeletePoints(points);
+      return true;
+    case CLEAR_OP: {
+      vector<Shape *>::iterator iter;
+      for (iter = shapes->begin(); iter < shapes->end(); ++iter) {
+        delete *iter;
+      }
+      shapes->clear();
+      DeletePoints(points);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Replays the journal of a save file onto the drawing just loaded from it.
+// Returns the number of records applied, or -1 if the journal can't be
+// extended: there is none for this version of the save file, or it ends in a
+// line cut short by a crash or holds a damaged one. Replay stops before any
+// such line, keeping every edit up to it.
+int ReplayJournal(const char *filename,
+                  vector<Shape *> *shapes, vector<Point2D *> *points) {
+  string identity;
+  if (!GetSaveFileIdentity(filename, &identity)) {
+    return -1;
+  }
+  string journal = GetJournalFilename(filename);
+  size_t size;
+  const char *data = MapFile(journal.c_str(), &size);
+  if (!data) {
+    return -1;
+  }
+  const char *end = data + size;
+  const char *p = (const char *) memchr(data, '\n', size);
+  if (!p || string(data, p) != identity) {
+    UnmapFile(data, size);
+    return -1;
+  }
+  ++p;
+  int numRecords = 0;
+  bool intact = true;
+  vector<double> numbers;
+  while (p < end) {
+    const char *lineEnd = (const char *) memchr(p, '\n', end - p);
+    if (!lineEnd) {
+      intact = false;
+      break;
+    }
+    if (!ParseRecord(p + 1, lineEnd, &numbers) ||
+        !ApplyRecord(*p, numbers, shapes, points)) {
+      cerr << "Error: invalid record " << numRecords + 1 << " in " << journal
+           << "." << endl;
+      intact = false;
+      break;
+    }
+    ++numRecords;
+    p = lineEnd + 1;
+  }
+  UnmapFile(data, size);
+
+  return intact ? numRecords : -1;
+}
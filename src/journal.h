@@ -0,0 +1,80 @@
+/*******************************************************************************
+   Filename: journal.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for EditJournal, which records edits to a drawing as
+             they're made so that a save only has to append what changed since
+             the last one. A journal file sits beside its save file, begins
+             with a header naming the exact save file it follows, and holds one
+             edit per line. Loading replays it on top of that save file.
+*******************************************************************************/
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <string>
+#include "shapes.h"
+
+const char JOURNAL_MAGIC[] = "DRAWJOURNAL";
+const int JOURNAL_VERSION = 1;
+const char JOURNAL_SUFFIX[] = ".journal";
+const int JOURNAL_COMPACT_RECORDS = 4096;  // past this, a save rewrites all
+
+// the first character of each journal line
+enum JournalOp {
+  ADD_SHAPE_OP = 'A',         // type n x0 y0 ... color filled
+  ADJUST_VERTEX_OP = 'J',     // shape vertex x y
+  MOVE_SHAPE_OP = 'M',        // shape vertex x y
+  SET_COLOR_OP = 'K',         // shape color
+  REMOVE_LAST_SHAPE_OP = 'R',
+  ADD_POINT_OP = 'P',         // x y
+  MOVE_POINT_OP = 'Q',        // point x y
+  REMOVE_LAST_POINT_OP = 'D',
+  CLEAR_POINTS_OP = 'E',
+  CLEAR_OP = 'X'
+};
+
+class EditJournal {
+ public:
+  EditJournal();
+  void Attach(const char *filename, int numRecords);
+  void Detach();
+  bool IsAttachedTo(const char *filename) const;
+  // Edits are only kept while following a save file; until the next save
+  // writes everything, there is nothing to append them to.
+  bool IsRecording() const { return !mFilename.empty(); }
+  bool NeedsCompaction() const;
+  string TakeRecords();
+
+  void RecordAddShape(const Shape *shape);
+  void RecordAdjustVertex(int shape, int vertex, double x, double y,
+                          bool absolute);
+  void RecordMoveShape(int shape, int vertex, double x, double y);
+  void RecordSetColor(int shape, PackedColor color);
+  void RecordRemoveLastShape();
+  void RecordAddPoint(double x, double y);
+  void RecordMovePoint(int point, double x, double y);
+  void RecordRemoveLastPoint();
+  void RecordClearPoints();
+  void RecordClear();
+ private:
+  void BeginRecord(JournalOp op, int index, int vertex,
+                   bool mergeable = true);
+  void AppendNumber(double value);
+
+  string mFilename;  // the save file being followed, or empty if none
+  string mRecords;   // written since the last save
+  int mNumSaved;     // records already in the journal file
+  int mNumRecords;   // records in mRecords
+  size_t mLastRecordStart;
+  int mLastOp, mLastIndex, mLastVertex;
+};
+
+string GetJournalFilename(const char *filename);
+bool WriteJournalHeader(const char *filename);
+bool AppendJournal(const char *filename, const string &records);
+int ReplayJournal(const char *filename,
+                  vector<Shape *> *shapes, vector<Point2D *> *points);
+
+#endif  // JOURNAL_H_
@@ -0,0 +1,97 @@
+/*******************************************************************************
+   Filename: meshcache.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for MeshCache. Meshes are kept by the slot
+             of each shape's handle, so they follow their shapes through
+             edits and reordering, and a slot reused by a new shape is seen
+             by its generation. Stale shapes are tessellated in chunks, each
+             into its own mesh, so the threads never share a buffer.
+*******************************************************************************/
+
+#include <chrono>
+#include "meshcache.h"
+#include "threadpool.h"
+
+MeshCache gMeshCache;
+
+MeshCache::MeshCache() {
+  mNextVersion = 0;
+  mNumTessellated = mNumCurveVertices = 0;
+  mSeconds = 0.0;
+}
+
+// Re-tessellates whichever of the shapes are new or dirty. The shapes mustn't
+// be edited meanwhile, but are only read until the loop is done; clearing
+// their dirty flags afterwards writes to the store, so it stays serial.
+void MeshCache::Prepare(const vector<Shape *> &shapes) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  mStale.clear();
+  vector<Shape *>::const_iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    if (IsStale(*iter)) {
+      mStale.push_back(*iter);
+    }
+  }
+  int numStale = mStale.size();
+  int numChunks = (numStale + MESH_CHUNK_SIZE - 1) / MESH_CHUNK_SIZE;
+  GetThreadPool()->ParallelFor(numChunks, [&](int k) {
+    int end = min((k + 1) * MESH_CHUNK_SIZE, numStale);
+    for (int i = k * MESH_CHUNK_SIZE; i < end; ++i) {
+      Mesh &mesh = mMeshes[mStale[i]->GetHandle().slot];
+      mesh.vertices.clear();
+      mStale[i]->Tessellate(&mesh.vertices);
+    }
+  });
+
+  mNumTessellated = numStale;
+  mNumCurveVertices = 0;
+  for (iter = mStale.begin(); iter < mStale.end(); ++iter) {
+    ShapeHandle handle = (*iter)->GetHandle();
+    Mesh &mesh = mMeshes[handle.slot];
+    mesh.generation = handle.generation;
+    mesh.version = ++mNextVersion;
+    mesh.mode = (*iter)->GetPrimitiveMode();
+    (*iter)->SetDirty(false);
+    ShapeType type = (*iter)->GetShapeType();
+    if (type == BEZIER_CURVE || type == CIRCLE) {
+      mNumCurveVertices += mesh.vertices.size();
+    }
+  }
+  mSeconds = chrono::duration<double>(
+               chrono::steady_clock::now() - start).count();
+}
+
+// Whether the shape's mesh is missing or out of date, making room for it.
+bool MeshCache::IsStale(const Shape *shape) {
+  ShapeHandle handle = shape->GetHandle();
+  if (handle.slot >= (int) mMeshes.size()) {
+    mMeshes.resize(handle.slot + 1);
+  }
+  const Mesh &mesh = mMeshes[handle.slot];
+
+  return shape->IsDirty() || mesh.version == 0 ||
+         mesh.generation != handle.generation;
+}
+
+// Copies the meshes of the shapes in drawing order, merging neighbors that
+// share a primitive mode into one run as TessellateShapes does.
+void MeshCache::AppendMeshes(const vector<Shape *> &shapes,
+                             vector<Vertex> *vertices,
+                             vector<DrawRun> *runs) const {
+  vector<Shape *>::const_iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    const Mesh &mesh = GetMesh(*iter);
+    int first = vertices->size();
+    vertices->insert(vertices->end(), mesh.vertices.begin(),
+                     mesh.vertices.end());
+    AppendDrawRun(runs, first, mesh.vertices.size(), mesh.mode);
+  }
+}
+
+// Frees every mesh, as when the drawing is cleared. Versions keep counting
+// up, so no mesh made later can be mistaken for one made before.
+void MeshCache::Clear() {
+  vector<Mesh>().swap(mMeshes);
+}
@@ -0,0 +1,55 @@
+/*******************************************************************************
+   Filename: meshcache.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for MeshCache, which keeps each shape's tessellated
+             vertices from one frame to the next. Before a frame is drawn,
+             the shapes that are new or have been marked dirty (by Adjust,
+             Move, SetColor, a change of curve tolerance or loading) are
+             re-tessellated on the thread pool, so a large import is
+             tessellated on every core; the backends then only copy or
+             submit the cached vertices.
+*******************************************************************************/
+
+#ifndef MESHCACHE_H_
+#define MESHCACHE_H_
+
+#include "raster.h"
+
+const int MESH_CHUNK_SIZE = 64;  // shapes per iteration of the parallel loop
+
+class MeshCache {
+ public:
+  struct Mesh {
+    unsigned int generation;  // of the handle it was tessellated for
+    unsigned long version;    // new for every tessellation; 0 for none yet
+    GLenum mode;
+    vector<Vertex> vertices;
+  };
+  MeshCache();
+  void Prepare(const vector<Shape *> &shapes);
+  // Only valid for a shape passed to the last call to Prepare.
+  const Mesh &GetMesh(const Shape *shape) const {
+    return mMeshes[shape->GetHandle().slot];
+  }
+  void AppendMeshes(const vector<Shape *> &shapes, vector<Vertex> *vertices,
+                    vector<DrawRun> *runs) const;
+  void Clear();
+  // by the last call to Prepare
+  int NumTessellated() const { return mNumTessellated; }
+  int NumCurveVertices() const { return mNumCurveVertices; }
+  double GetSeconds() const { return mSeconds; }
+ private:
+  bool IsStale(const Shape *shape);
+
+  vector<Mesh> mMeshes;    // by the slot of each shape's handle
+  vector<Shape *> mStale;  // scratch space for Prepare
+  unsigned long mNextVersion;
+  int mNumTessellated, mNumCurveVertices;
+  double mSeconds;
+};
+
+extern MeshCache gMeshCache;  // for the shapes in gScene
+
+#endif  // MESHCACHE_H_
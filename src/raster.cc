@@ -0,0 +1,437 @@
+/*******************************************************************************
+   Filename: raster.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for SoftwareRasterizer and the batch render
+             mode. Coverage follows OpenGL's rules for the same vertices: a
+             triangle covers the pixels whose centers lie inside it (ties on
+             an edge go to its top or left side), and a line covers one pixel
+             per column (or row, if steep) whose center it passes, excluding
+             its last. Each pixel's coverage depends only on the primitive,
+             never on the tile, so tiled output matches untiled output.
+*******************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include "raster.h"
+#include "backend.h"
+#include "savefile.h"
+#include "threadpool.h"
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height) {
+  mWidth = width > 0 ? width : 1;
+  mHeight = height > 0 ? height : 1;
+  mPool = NULL;
+  mPixels.resize(mWidth * mHeight * 3);
+  SetView(0.0, 0.0, 1.0);
+  SetTileSize(RASTER_TILE_SIZE);
+  PixelRect all = {0, 0, mWidth, mHeight};
+  SetClip(all);
+  Clear(RENDER_BACKGROUND, RENDER_BACKGROUND, RENDER_BACKGROUND);
+}
+
+void SoftwareRasterizer::Clear(unsigned char r, unsigned char g,
+                               unsigned char b) {
+  for (int y = mClip.bottom; y < mClip.top; ++y) {
+    unsigned char *pixel = &mPixels[(y * mWidth + mClip.left) * 3];
+    for (int x = mClip.left; x < mClip.right; ++x, pixel += 3) {
+      pixel[0] = r;
+      pixel[1] = g;
+      pixel[2] = b;
+    }
+  }
+}
+
+// Maps the drawing point (left, bottom) to the image's bottom-left corner,
+// with scale image pixels per drawing pixel.
+void SoftwareRasterizer::SetView(double left, double bottom, double scale) {
+  mLeft = left;
+  mBottom = bottom;
+  mScale = scale;
+}
+
+// A tile size at least as large as the image draws it as a single tile on the
+// calling thread.
+void SoftwareRasterizer::SetTileSize(int tileSize) {
+  mTileSize = max(tileSize, 1);
+  mTilesX = (mWidth + mTileSize - 1) / mTileSize;
+  mTilesY = (mHeight + mTileSize - 1) / mTileSize;
+}
+
+// Clamps the clip rectangle to the image; an empty one leaves it untouched.
+void SoftwareRasterizer::SetClip(const PixelRect &clip) {
+  mClip.left = max(clip.left, 0);
+  mClip.bottom = max(clip.bottom, 0);
+  mClip.right = max(min(clip.right, mWidth), mClip.left);
+  mClip.top = max(min(clip.top, mHeight), mClip.bottom);
+}
+
+void SoftwareRasterizer::Draw(const vector<Vertex> &vertices,
+                              const vector<DrawRun> &runs) {
+  Bin(vertices, runs);
+  ThreadPool *pool = mPool ? mPool : GetThreadPool();
+  pool->ParallelFor(NumTiles(), [&](int tile) {
+    DrawTile(tile, vertices);
+  });
+}
+
+// Transforms the vertices to image coordinates and lists each primitive in
+// every tile its bounding box overlaps within the clip rectangle, keeping
+// drawing order within a tile.
+void SoftwareRasterizer::Bin(const vector<Vertex> &vertices,
+                             const vector<DrawRun> &runs) {
+  mXs.resize(vertices.size());
+  mYs.resize(vertices.size());
+  for (int i = 0; i < (int) vertices.size(); ++i) {
+    mXs[i] = (vertices[i].x - mLeft) * mScale;
+    mYs[i] = (vertices[i].y - mBottom) * mScale;
+  }
+  mPrimitives.clear();
+  mBins.resize(NumTiles());
+  for (int i = 0; i < (int) mBins.size(); ++i) {
+    mBins[i].clear();
+  }
+  vector<DrawRun>::const_iterator iter;
+  for (iter = runs.begin(); iter < runs.end(); ++iter) {
+    bool triangle = iter->mode == GL_TRIANGLES;
+    int size = triangle ? 3 : 2;
+    for (int first = iter->first;
+         first + size <= iter->first + iter->count;
+         first += size) {
+      double minX = mXs[first], maxX = minX;
+      double minY = mYs[first], maxY = minY;
+      for (int j = first + 1; j < first + size; ++j) {
+        minX = min(minX, mXs[j]);
+        maxX = max(maxX, mXs[j]);
+        minY = min(minY, mYs[j]);
+        maxY = max(maxY, mYs[j]);
+      }
+      Primitive primitive;
+      primitive.first = first;
+      primitive.triangle = triangle;
+      primitive.left = max(mClip.left, (int) floor(minX) - 1);
+      primitive.bottom = max(mClip.bottom, (int) floor(minY) - 1);
+      primitive.right = min(mClip.right - 1, (int) ceil(maxX) + 1);
+      primitive.top = min(mClip.top - 1, (int) ceil(maxY) + 1);
+      if (primitive.left > primitive.right ||
+          primitive.bottom > primitive.top) {
+        continue;  // entirely outside the clip rectangle
+      }
+      int index = mPrimitives.size();
+      mPrimitives.push_back(primitive);
+      for (int ty = primitive.bottom / mTileSize;
+           ty <= primitive.top / mTileSize; ++ty) {
+        for (int tx = primitive.left / mTileSize;
+             tx <= primitive.right / mTileSize; ++tx) {
+          mBins[ty * mTilesX + tx].push_back(index);
+        }
+      }
+    }
+  }
+}
+
+void SoftwareRasterizer::DrawTile(int tile, const vector<Vertex> &vertices) {
+  PixelRect clip;
+  clip.left = max(tile % mTilesX * mTileSize, mClip.left);
+  clip.bottom = max(tile / mTilesX * mTileSize, mClip.bottom);
+  clip.right = min(tile % mTilesX * mTileSize + mTileSize, mClip.right);
+  clip.top = min(tile / mTilesX * mTileSize + mTileSize, mClip.top);
+  vector<int>::const_iterator iter;
+  for (iter = mBins[tile].begin(); iter < mBins[tile].end(); ++iter) {
+    const Primitive &primitive = mPrimitives[*iter];
+    if (primitive.triangle) {
+      DrawTriangle(primitive, vertices[primitive.first], clip);
+    } else {
+      DrawLine(primitive, vertices[primitive.first], clip);
+    }
+  }
+}
+
+// A counterclockwise triangle's left edges run downward and its top edges run
+// leftward; a pixel center exactly on an edge belongs to the triangle only if
+// the edge is one of those, so shared edges are never drawn twice.
+static bool IsTopLeftEdge(double x0, double y0, double x1, double y1) {
+  return y1 < y0 || (y1 == y0 && x1 < x0);
+}
+
+// Fills a triangle, in the color of its first vertex, within clip.
+void SoftwareRasterizer::DrawTriangle(const Primitive &primitive,
+                                      const Vertex &color,
+                                      const PixelRect &clip) {
+  const double *xs = &mXs[primitive.first], *ys = &mYs[primitive.first];
+  double x0 = xs[0], y0 = ys[0], x1 = xs[1], y1 = ys[1], x2 = xs[2],
+         y2 = ys[2];
+  double area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+  if (area == 0.0) {
+    return;
+  } else if (area < 0.0) {
+    swap(x1, x2);
+    swap(y1, y2);
+  }
+  bool topLeft0 = IsTopLeftEdge(x0, y0, x1, y1);
+  bool topLeft1 = IsTopLeftEdge(x1, y1, x2, y2);
+  bool topLeft2 = IsTopLeftEdge(x2, y2, x0, y0);
+  int left = max(primitive.left, clip.left);
+  int right = min(primitive.right + 1, clip.right);
+  int bottom = max(primitive.bottom, clip.bottom);
+  int top = min(primitive.top + 1, clip.top);
+  for (int y = bottom; y < top; ++y) {
+    double py = y + 0.5;
+    double row0 = (x1 - x0) * (py - y0);
+    double row1 = (x2 - x1) * (py - y1);
+    double row2 = (x0 - x2) * (py - y2);
+    unsigned char *pixel = &mPixels[(y * mWidth + left) * 3];
+    for (int x = left; x < right; ++x, pixel += 3) {
+      double px = x + 0.5;
+      double e0 = row0 - (y1 - y0) * (px - x0);
+      double e1 = row1 - (y2 - y1) * (px - x1);
+      double e2 = row2 - (y0 - y2) * (px - x2);
+      if ((e0 > 0.0 || (e0 == 0.0 && topLeft0)) &&
+          (e1 > 0.0 || (e1 == 0.0 && topLeft1)) &&
+          (e2 > 0.0 || (e2 == 0.0 && topLeft2))) {
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+      }
+    }
+  }
+}
+
+// Draws a one-pixel-wide line, in the color of its first vertex, within
+// clip. Stepping along the major axis, it covers each pixel whose center
+// lies between the endpoints, counting the first endpoint but not the last.
+void SoftwareRasterizer::DrawLine(const Primitive &primitive,
+                                  const Vertex &color, const PixelRect &clip) {
+  double x0 = mXs[primitive.first], y0 = mYs[primitive.first];
+  double x1 = mXs[primitive.first + 1], y1 = mYs[primitive.first + 1];
+  bool steep = fabs(y1 - y0) > fabs(x1 - x0);
+  if (steep) {
+    swap(x0, y0);
+    swap(x1, y1);
+  }
+  if (x0 == x1) {
+    return;
+  }
+  // major-axis pixels with x0 <= center < x1, or x1 < center <= x0
+  int first, last;
+  if (x0 < x1) {
+    first = (int) ceil(x0 - 0.5);
+    last = (int) ceil(x1 - 0.5) - 1;
+  } else {
+    first = (int) floor(x1 - 0.5) + 1;
+    last = (int) floor(x0 - 0.5);
+  }
+  int minMajor = steep ? clip.bottom : clip.left;
+  int maxMajor = (steep ? clip.top : clip.right) - 1;
+  int minMinor = steep ? clip.left : clip.bottom;
+  int maxMinor = (steep ? clip.right : clip.top) - 1;
+  double slope = (y1 - y0) / (x1 - x0);
+  for (int major = max(first, minMajor); major <= min(last, maxMajor);
+       ++major) {
+    int minor = (int) floor(y0 + (major + 0.5 - x0) * slope);
+    if (minor < minMinor || minor > maxMinor) {
+      continue;
+    }
+    int x = steep ? minor : major;
+    int y = steep ? major : minor;
+    unsigned char *pixel = &mPixels[(y * mWidth + x) * 3];
+    pixel[0] = color.r;
+    pixel[1] = color.g;
+    pixel[2] = color.b;
+  }
+}
+
+bool SoftwareRasterizer::WritePPM(const char *filename) const {
+  ofstream fout(filename, ios::binary);
+  if (!fout.good()) {
+    cerr << "Error: unable to write " << filename << "." << endl;
+    return false;
+  }
+  fout << "P6\n" << mWidth << " " << mHeight << "\n255\n";
+  for (int y = mHeight - 1; y >= 0; --y) {
+    fout.write((const char *) &mPixels[y * mWidth * 3], mWidth * 3);
+  }
+  fout.close();
+
+  return !fout.fail();
+}
+
+// Scales and centers a view of an image of the given size so that every
+// vertex lands inside it, leaving a margin around the drawing.
+void FitView(const vector<Vertex> &vertices, int width, int height,
+             double *left, double *bottom, double *scale) {
+  *left = *bottom = 0.0;
+  *scale = 1.0;
+  if (vertices.empty()) {
+    return;
+  }
+  double minX = vertices[0].x, maxX = minX;
+  double minY = vertices[0].y, maxY = minY;
+  vector<Vertex>::const_iterator iter;
+  for (iter = vertices.begin(); iter < vertices.end(); ++iter) {
+    minX = min(minX, (double) iter->x);
+    maxX = max(maxX, (double) iter->x);
+    minY = min(minY, (double) iter->y);
+    maxY = max(maxY, (double) iter->y);
+  }
+  double drawingWidth = max(maxX - minX, 1.0);
+  double drawingHeight = max(maxY - minY, 1.0);
+  *scale = min((width - 2.0 * RENDER_MARGIN) / drawingWidth,
+               (height - 2.0 * RENDER_MARGIN) / drawingHeight);
+  if (*scale <= 0.0) {
+    *scale = min(width / drawingWidth, height / drawingHeight);
+  }
+  *left = (minX + maxX) / 2.0 - width / (2.0 * *scale);
+  *bottom = (minY + maxY) / 2.0 - height / (2.0 * *scale);
+}
+
+// Tessellates shapes in drawing order, merging neighbors that share a
+// primitive mode into one run as VertexBufferRenderer does.
+void TessellateShapes(const vector<Shape *> &shapes,
+                      vector<Vertex> *vertices, vector<DrawRun> *runs) {
+  vector<Shape *>::const_iterator iter;
+  for (iter = shapes.begin(); iter < shapes.end(); ++iter) {
+    int first = vertices->size();
+    (*iter)->Tessellate(vertices);
+    AppendDrawRun(runs, first, vertices->size() - first,
+                  (*iter)->GetPrimitiveMode());
+  }
+}
+
+// Adds count vertices from first on to the last run if it shares their mode,
+// or starts a new run.
+void AppendDrawRun(vector<DrawRun> *runs, int first, int count,
+                   GLenum mode) {
+  if (count == 0) {
+    return;
+  }
+  if (!runs->empty() && runs->back().mode == mode) {
+    runs->back().count += count;
+  } else {
+    DrawRun run;
+    run.first = first;
+    run.count = count;
+    run.mode = mode;
+    runs->push_back(run);
+  }
+}
+
+//
+// Batch rendering:
+//
+
+// Shapes live in gScene and the document arena, neither of which is safe to
+// use from two threads at once, so the brief step that builds and tessellates
+// them is serialized; loading, rasterizing and writing run in parallel.
+static mutex gDocumentMutex;
+
+struct RenderResult {
+  bool rendered;
+  int numShapes;
+  double loadSeconds, tessellateSeconds, drawSeconds, writeSeconds;
+};
+
+static void RenderSaveFile(const char *filename, int width, int height,
+                           RenderMode mode, RenderResult *result) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  SceneData data;
+  result->rendered = LoadSceneData(filename, &data);
+  result->numShapes = data.types.size();
+  chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+  result->loadSeconds = chrono::duration<double>(loaded - start).count();
+  if (!result->rendered) {
+    return;
+  }
+
+  vector<Vertex> vertices;
+  vector<DrawRun> runs;
+  {
+    lock_guard<mutex> lock(gDocumentMutex);
+    vector<Shape *> shapes;
+    vector<Point2D *> points;
+    result->rendered = BuildScene(data, &shapes, &points);
+    TessellateShapes(shapes, &vertices, &runs);
+    // newest first, so each removal just shortens the store and arena
+    vector<Shape *>::reverse_iterator shapeIter;
+    for (shapeIter = shapes.rbegin(); shapeIter < shapes.rend();
+         ++shapeIter) {
+      delete *shapeIter;
+    }
+    vector<Point2D *>::reverse_iterator pointIter;
+    for (pointIter = points.rbegin(); pointIter < points.rend();
+         ++pointIter) {
+      delete *pointIter;
+    }
+  }
+  if (!result->rendered) {
+    return;
+  }
+  chrono::steady_clock::time_point tessellated = chrono::steady_clock::now();
+  result->tessellateSeconds = chrono::duration<double>(tessellated -
+                                                       loaded).count();
+
+  string outFilename = string(filename) + GetRenderFileSuffix(mode);
+  RenderBackend *backend = CreateRenderBackend(mode, outFilename.c_str());
+  double left, bottom, scale;
+  FitView(vertices, width, height, &left, &bottom, &scale);
+  backend->BeginFrame(width, height, left, bottom, scale);
+  backend->DrawStream(vertices, runs);
+  chrono::steady_clock::time_point drawn = chrono::steady_clock::now();
+  result->drawSeconds = chrono::duration<double>(drawn -
+                                                 tessellated).count();
+
+  result->rendered = backend->EndFrame();
+  delete backend;
+  result->writeSeconds = chrono::duration<double>(
+                           chrono::steady_clock::now() - drawn).count();
+}
+
+// Renders each save file to an image of the given size beside it (as
+// <file>.ppm with the software backend or <file>.svg with the SVG one),
+// scaled to fit, with files spread across the thread pool. For the --render
+// command-line option; returns the process exit status.
+int RenderSaveFiles(int width, int height, RenderMode mode,
+                    int numFiles, char **filenames) {
+  if (width <= 0 || height <= 0) {
+    cerr << "Error: invalid image size " << width << "x" << height << "."
+         << endl;
+    return 1;
+  }
+  if (!GetRenderFileSuffix(mode)) {
+    cerr << "Error: the " << RENDER_MODE_NAMES[mode]
+         << " backend needs a window." << endl;
+    return 1;
+  }
+  vector<RenderResult> results(numFiles);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  GetThreadPool()->ParallelFor(numFiles, [&](int i) {
+    RenderSaveFile(filenames[i], width, height, mode, &results[i]);
+  });
+  double seconds = chrono::duration<double>(
+                     chrono::steady_clock::now() - start).count();
+
+  int failures = 0;
+  for (int i = 0; i < numFiles; ++i) {
+    const RenderResult &result = results[i];
+    if (!result.rendered) {
+      cerr << "Error: unable to render " << filenames[i] << "." << endl;
+      ++failures;
+      continue;
+    }
+    cout << filenames[i] << ": " << result.numShapes << " shapes, "
+         << 1000.0 * (result.loadSeconds + result.tessellateSeconds +
+                      result.drawSeconds + result.writeSeconds)
+         << " ms (load " << 1000.0 * result.loadSeconds
+         << ", tessellate " << 1000.0 * result.tessellateSeconds
+         << ", draw " << 1000.0 * result.drawSeconds
+         << ", write " << 1000.0 * result.writeSeconds << ")" << endl;
+  }
+  cout << numFiles - failures << " of " << numFiles << " files rendered at "
+       << width << "x" << height << " with the " << RENDER_MODE_NAMES[mode]
+       << " backend in " << 1000.0 * seconds << " ms on "
+       << GetThreadPool()->NumThreads() << " threads" << endl;
+
+  return failures == 0 ? 0 : 1;
+}
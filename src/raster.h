@@ -0,0 +1,81 @@
+/*******************************************************************************
+   Filename: raster.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for SoftwareRasterizer, which draws tessellated
+             shapes (the same vertices the retained-mode renderer uploads)
+             into an RGB image in memory, and for the headless batch mode
+             that renders save files to images without opening a window.
+             The image is split into square tiles; each primitive is binned
+             into the tiles it touches and the tiles are drawn in parallel.
+             A clip rectangle confines drawing to part of the image, leaving
+             the rest as it was.
+*******************************************************************************/
+
+#ifndef RASTER_H_
+#define RASTER_H_
+
+#include "shapes.h"
+
+const int RENDER_MARGIN = 4;  // pixels left blank around a fitted drawing
+const unsigned char RENDER_BACKGROUND = 255;  // white, like the canvas
+const int RASTER_TILE_SIZE = 64;  // pixels on a side
+
+// A run of vertices drawn with one primitive mode (GL_TRIANGLES or GL_LINES).
+struct DrawRun {
+  int first, count;
+  GLenum mode;
+};
+
+class ThreadPool;
+
+class SoftwareRasterizer {
+ public:
+  SoftwareRasterizer(int width, int height);
+  void Clear(unsigned char r, unsigned char g, unsigned char b);
+  void SetView(double left, double bottom, double scale);
+  void SetTileSize(int tileSize);
+  void SetClip(const PixelRect &clip);
+  void SetThreadPool(ThreadPool *pool) { mPool = pool; }
+  void Draw(const vector<Vertex> &vertices, const vector<DrawRun> &runs);
+  bool WritePPM(const char *filename) const;
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+  int NumTiles() const { return mTilesX * mTilesY; }
+  const unsigned char *GetPixels() const { return &mPixels[0]; }
+ private:
+  // A triangle or line, by its first vertex, with the pixels it may touch.
+  struct Primitive {
+    int first;
+    bool triangle;
+    int left, bottom, right, top;  // inclusive
+  };
+  void Bin(const vector<Vertex> &vertices, const vector<DrawRun> &runs);
+  void DrawTile(int tile, const vector<Vertex> &vertices);
+  void DrawTriangle(const Primitive &primitive, const Vertex &color,
+                    const PixelRect &clip);
+  void DrawLine(const Primitive &primitive, const Vertex &color,
+                const PixelRect &clip);
+
+  int mWidth, mHeight;
+  double mLeft, mBottom, mScale;  // image x = (x - mLeft) * mScale, etc.
+  int mTileSize, mTilesX, mTilesY;
+  PixelRect mClip;  // the only pixels Clear and Draw touch
+  ThreadPool *mPool;  // that tiles are drawn on, or NULL for the shared one
+  vector<unsigned char> mPixels;  // RGB, bottom row first as in OpenGL
+  vector<double> mXs, mYs;        // vertices in image coordinates
+  vector<Primitive> mPrimitives;  // in drawing order
+  vector<vector<int> > mBins;     // primitives touching each tile, in order
+};
+
+void TessellateShapes(const vector<Shape *> &shapes,
+                      vector<Vertex> *vertices, vector<DrawRun> *runs);
+void AppendDrawRun(vector<DrawRun> *runs, int first, int count,
+                   GLenum mode);
+void FitView(const vector<Vertex> &vertices, int width, int height,
+             double *left, double *bottom, double *scale);
+int RenderSaveFiles(int width, int height, RenderMode mode,
+                    int numFiles, char **filenames);
+
+#endif  // RASTER_H_
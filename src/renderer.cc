@@ -0,0 +1,361 @@
+/*******************************************************************************
+   Filename: renderer.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for VertexBufferRenderer and HandleRenderer.
+             Shapes are packed into one vertex array in drawing order so
+             batching never changes which shape ends up on top. Shapes are
+             tessellated by MeshCache; only the ranges of shapes whose meshes
+             it has remade since the last frame are copied and re-uploaded.
+*******************************************************************************/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include "renderer.h"
+#include "meshcache.h"
+
+const int MIN_BUFFER_CAPACITY = 1024;
+
+VertexBufferRenderer::VertexBufferRenderer() {
+  int major = 0, minor = 0;
+  const char *version = (const char *) glGetString(GL_VERSION);
+
+  // vertex buffer objects are core as of OpenGL 1.5; older drivers fall back
+  // to client-side vertex arrays, which still batch the draw calls
+  if (version) {
+    sscanf(version, "%d.%d", &major, &minor);
+  }
+  mUseBufferObjects = major > 1 || (major == 1 && minor >= 5);
+  mBuffer = 0;
+  mBufferCapacity = 0;
+  if (mUseBufferObjects) {
+    glGenBuffers(1, &mBuffer);
+  }
+}
+
+VertexBufferRenderer::~VertexBufferRenderer() {
+  if (mUseBufferObjects) {
+    glDeleteBuffers(1, &mBuffer);
+  }
+}
+
+void VertexBufferRenderer::Draw(const vector<Shape *> &shapes) {
+  Sync(shapes);
+  if (mVertices.empty()) {
+    return;
+  }
+
+  const char *base = NULL;
+  if (mUseBufferObjects) {
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+  } else {
+    base = (const char *) &mVertices[0];
+  }
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, x));
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex),
+                 base + offsetof(Vertex, r));
+  vector<Batch>::iterator iter;
+  for (iter = mBatches.begin(); iter < mBatches.end(); ++iter) {
+    glDrawArrays(iter->mode, iter->first, iter->count);
+  }
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  if (mUseBufferObjects) {
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+// Forces every shape to be re-tessellated on the next call to Draw().
+void VertexBufferRenderer::Invalidate() {
+  Truncate(0);
+  mBatches.clear();
+}
+
+void VertexBufferRenderer::Sync(const vector<Shape *> &shapes) {
+  gMeshCache.Prepare(shapes);
+  int numShapes = shapes.size();
+  int numPacked = mShapes.size();
+  int firstChanged = numPacked < numShapes ? numPacked : numShapes;
+
+  // find the first slot whose shape was replaced (undo, clear, load, etc.)
+  for (int i = 0; i < firstChanged; ++i) {
+    if (mShapes[i] != shapes[i]) {
+      firstChanged = i;
+      break;
+    }
+  }
+
+  // copy re-tessellated meshes in place while their vertex counts hold
+  int dirtyFirst = mVertices.size(), dirtyLast = 0;
+  for (int i = 0; i < firstChanged; ++i) {
+    const MeshCache::Mesh &mesh = gMeshCache.GetMesh(shapes[i]);
+    ShapeRange &range = mRanges[i];
+    if (mesh.version == range.version) {
+      continue;
+    }
+    if ((int) mesh.vertices.size() != range.count ||
+        mesh.mode != range.mode) {
+      firstChanged = i;
+      break;
+    }
+    copy(mesh.vertices.begin(), mesh.vertices.end(),
+         mVertices.begin() + range.offset);
+    range.version = mesh.version;
+    if (range.offset < dirtyFirst) {
+      dirtyFirst = range.offset;
+    }
+    if (range.offset + range.count > dirtyLast) {
+      dirtyLast = range.offset + range.count;
+    }
+  }
+
+  // repack everything from the first structural change onward
+  if (firstChanged < numPacked || numShapes > numPacked) {
+    Truncate(firstChanged);
+    int appendFrom = mVertices.size();
+    Append(shapes, firstChanged);
+    BuildBatches();
+    if (appendFrom < dirtyFirst) {
+      dirtyFirst = appendFrom;
+    }
+    dirtyLast = mVertices.size();
+  }
+
+  if (dirtyFirst < dirtyLast) {
+    Upload(dirtyFirst, dirtyLast - dirtyFirst);
+  }
+}
+
+void VertexBufferRenderer::Truncate(int numShapes) {
+  if (numShapes < (int) mShapes.size()) {
+    mVertices.resize(mRanges[numShapes].offset);
+    mShapes.resize(numShapes);
+    mRanges.resize(numShapes);
+  }
+}
+
+void VertexBufferRenderer::Append(const vector<Shape *> &shapes, int first) {
+  for (int i = first; i < (int) shapes.size(); ++i) {
+    const MeshCache::Mesh &mesh = gMeshCache.GetMesh(shapes[i]);
+    ShapeRange range;
+    range.offset = mVertices.size();
+    range.count = mesh.vertices.size();
+    range.mode = mesh.mode;
+    range.version = mesh.version;
+    mVertices.insert(mVertices.end(), mesh.vertices.begin(),
+                     mesh.vertices.end());
+    mShapes.push_back(shapes[i]);
+    mRanges.push_back(range);
+  }
+}
+
+void VertexBufferRenderer::BuildBatches() {
+  mBatches.clear();
+  vector<ShapeRange>::iterator iter;
+  for (iter = mRanges.begin(); iter < mRanges.end(); ++iter) {
+    if (iter->count == 0) {
+      continue;
+    }
+    if (!mBatches.empty() && mBatches.back().mode == iter->mode) {
+      mBatches.back().count += iter->count;
+    } else {
+      Batch batch;
+      batch.first = iter->offset;
+      batch.count = iter->count;
+      batch.mode = iter->mode;
+      mBatches.push_back(batch);
+    }
+  }
+}
+
+void VertexBufferRenderer::Upload(int firstVertex, int numVertices) {
+  if (!mUseBufferObjects || mVertices.empty()) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+  if ((int) mVertices.size() > mBufferCapacity) {
+    // grow geometrically so interactive drawing doesn't reallocate per shape
+    mBufferCapacity = mVertices.size() * 2;
+    if (mBufferCapacity < MIN_BUFFER_CAPACITY) {
+      mBufferCapacity = MIN_BUFFER_CAPACITY;
+    }
+    glBufferData(GL_ARRAY_BUFFER, mBufferCapacity * sizeof(Vertex), NULL,
+                 GL_DYNAMIC_DRAW);
+    firstVertex = 0;
+    numVertices = mVertices.size();
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(Vertex),
+                  numVertices * sizeof(Vertex), &mVertices[firstVertex]);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//
+// HandleRenderer methods:
+//
+
+const int HANDLE_TEXTURE_SIZE = 32;
+
+HandleRenderer::HandleRenderer() {
+  int major = 0;
+  const char *version = (const char *) glGetString(GL_VERSION);
+
+  // point sprites are core as of OpenGL 2.0; older drivers draw each handle
+  // as a polygon instead
+  if (version) {
+    sscanf(version, "%d", &major);
+  }
+  mUsePointSprites = major >= 2;
+  mTexture = 0;
+  if (!mUsePointSprites) {
+    return;
+  }
+
+  // a disc mask: opaque inside the circle, transparent outside
+  GLubyte disc[HANDLE_TEXTURE_SIZE * HANDLE_TEXTURE_SIZE];
+  double center = HANDLE_TEXTURE_SIZE / 2.0;
+  for (int y = 0; y < HANDLE_TEXTURE_SIZE; ++y) {
+    for (int x = 0; x < HANDLE_TEXTURE_SIZE; ++x) {
+      double dx = x + 0.5 - center;
+      double dy = y + 0.5 - center;
+      disc[y * HANDLE_TEXTURE_SIZE + x] =
+        dx * dx + dy * dy <= center * center ? 255 : 0;
+    }
+  }
+  glGenTextures(1, &mTexture);
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, HANDLE_TEXTURE_SIZE,
+               HANDLE_TEXTURE_SIZE, 0, GL_ALPHA, GL_UNSIGNED_BYTE, disc);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+HandleRenderer::~HandleRenderer() {
+  if (mTexture) {
+    glDeleteTextures(1, &mTexture);
+  }
+}
+
+// Draws a handle of radius POINT_RADIUS centered on each (x, y) pair.
+void HandleRenderer::Draw(const vector<GLfloat> &positions) {
+  int n = positions.size() / 2;
+  if (n == 0) {
+    return;
+  }
+  glColor3d(DEFAULT_POINT_RED, DEFAULT_POINT_GREEN, DEFAULT_POINT_BLUE);
+  if (!mUsePointSprites) {
+    for (int i = 0; i < n; ++i) {
+      DrawCircle(positions[2 * i], positions[2 * i + 1], POINT_RADIUS);
+    }
+    return;
+  }
+
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_POINT_SPRITE);
+  glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.5f);
+  glPointSize(2.0f * POINT_RADIUS);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 0, &positions[0]);
+  glDrawArrays(GL_POINTS, 0, n);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  glPointSize(1.0f);
+  glDisable(GL_ALPHA_TEST);
+  glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_FALSE);
+  glDisable(GL_POINT_SPRITE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_TEXTURE_2D);
+}
+
+//
+// LayerCache methods:
+//
+
+LayerCache::LayerCache() {
+  mTexture = 0;
+  mX = mY = mWidth = mHeight = 0;
+  mValid = false;
+}
+
+LayerCache::~LayerCache() {
+  if (mTexture) {
+    glDeleteTextures(1, &mTexture);
+  }
+}
+
+// Copies the given rectangle of the back buffer into the cache's texture.
+void LayerCache::Capture(int x, int y, int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  ClearGLErrors();
+  if (!mTexture) {
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  } else {
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+  }
+  glReadBuffer(GL_BACK);
+  if (width == mWidth && height == mHeight) {
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, width, height);
+  } else {
+    glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y, width, height, 0);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  mX = x;
+  mY = y;
+  mWidth = width;
+  mHeight = height;
+  mValid = glGetError() == GL_NO_ERROR;
+}
+
+// Recopies part of the captured rectangle from the back buffer, leaving the
+// rest of the texture as it was.
+void LayerCache::Update(int x, int y, int width, int height) {
+  int left = max(x, mX), bottom = max(y, mY);
+  int right = min(x + width, mX + mWidth);
+  int top = min(y + height, mY + mHeight);
+  if (!mValid || left >= right || bottom >= top) {
+    return;
+  }
+  ClearGLErrors();
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glReadBuffer(GL_BACK);
+  glCopyTexSubImage2D(GL_TEXTURE_2D, 0, left - mX, bottom - mY, left, bottom,
+                      right - left, top - bottom);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  mValid = glGetError() == GL_NO_ERROR;
+}
+
+void LayerCache::Draw() const {
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glBegin(GL_QUADS);
+  glTexCoord2d(0, 0);
+  glVertex2d(mX, mY);
+  glTexCoord2d(1, 0);
+  glVertex2d(mX + mWidth, mY);
+  glTexCoord2d(1, 1);
+  glVertex2d(mX + mWidth, mY + mHeight);
+  glTexCoord2d(0, 1);
+  glVertex2d(mX, mY + mHeight);
+  glEnd();
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_TEXTURE_2D);
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+   Filename: renderer.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for VertexBufferRenderer, a retained-mode renderer
+             that packs the geometry of every shape into a single vertex
+             buffer and draws the scene with a handful of batched calls;
+             HandleRenderer, which draws every control-point handle as a
+             textured point sprite in one call; and LayerCache, which keeps a
+             rarely changing part of the screen (or the whole of the last
+             frame) in a texture.
+*******************************************************************************/
+
+#ifndef RENDERER_H_
+#define RENDERER_H_
+
+#include "shapes.h"
+
+class VertexBufferRenderer {
+ public:
+  VertexBufferRenderer();
+  ~VertexBufferRenderer();
+  void Draw(const vector<Shape *> &shapes);
+  void Invalidate();
+  int NumBatches() const { return mBatches.size(); }
+  int NumVertices() const { return mVertices.size(); }
+  bool UsesBufferObjects() const { return mUseBufferObjects; }
+ private:
+  // Each shape owns a contiguous range of the vertex array.
+  struct ShapeRange {
+    int offset, count;
+    GLenum mode;
+    unsigned long version;  // of the mesh copied into it
+  };
+  // Consecutive shapes sharing a primitive mode are drawn in one call.
+  struct Batch {
+    int first, count;
+    GLenum mode;
+  };
+  void Sync(const vector<Shape *> &shapes);
+  void Truncate(int numShapes);
+  void Append(const vector<Shape *> &shapes, int first);
+  void BuildBatches();
+  void Upload(int firstVertex, int numVertices);
+
+  vector<Shape *> mShapes;
+  vector<ShapeRange> mRanges;
+  vector<Vertex> mVertices;
+  vector<Batch> mBatches;
+  GLuint mBuffer;
+  int mBufferCapacity;  // in vertices
+  bool mUseBufferObjects;
+};
+
+class HandleRenderer {
+ public:
+  HandleRenderer();
+  ~HandleRenderer();
+  void Draw(const vector<GLfloat> &positions);
+ private:
+  GLuint mTexture;
+  bool mUsePointSprites;
+};
+
+class LayerCache {
+ public:
+  LayerCache();
+  ~LayerCache();
+  void Capture(int x, int y, int width, int height);
+  void Update(int x, int y, int width, int height);
+  void Draw() const;
+  void Invalidate() { mValid = false; }
+  bool IsValid() const { return mValid; }
+ private:
+  GLuint mTexture;
+  int mX, mY, mWidth, mHeight;
+  bool mValid;
+};
+
+#endif  // RENDERER_H_
@@ -0,0 +1,105 @@
+/*******************************************************************************
+   Filename: renderthread.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for RenderThread. The render thread keeps
+             one image between snapshots and redraws only each snapshot's
+             clip rectangle, then copies the whole image out, so any frame
+             the GLUT thread takes is complete.
+*******************************************************************************/
+
+#include <chrono>
+#include "renderthread.h"
+#include "threadpool.h"
+
+RenderThread::RenderThread() {
+  mRasterizer = NULL;
+  mSerial = 0;
+  mFramesDrawn = 0;
+  mDrawSeconds = 0.0;
+  mStopping = false;
+  mPool = new ThreadPool(GetThreadPool()->NumThreads());
+  mThread = thread(&RenderThread::Run, this);
+}
+
+// Waits for the snapshot being drawn, if any; the rest are dropped.
+RenderThread::~RenderThread() {
+  {
+    lock_guard<mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWake.notify_one();
+  mThread.join();
+  delete mRasterizer;
+  delete mPool;
+}
+
+// Hands the filled-in snapshot to the render thread, replacing any it hasn't
+// started on, and returns its serial number. Never waits for drawing: the
+// mutex is held by the render thread only while it checks for work.
+long RenderThread::PublishScene() {
+  long serial = ++mSerial;
+  mScenes.GetBack()->serial = serial;
+  mScenes.Publish();
+  {
+    lock_guard<mutex> lock(mMutex);
+  }
+  mWake.notify_one();
+
+  return serial;
+}
+
+// Returns the newest finished frame, or NULL if none has been finished yet.
+// It stays valid until the next call.
+const RenderedFrame *RenderThread::TakeFrame() {
+  mFrames.Update();
+
+  return GetFrame();
+}
+
+// Returns the frame last taken, or NULL if none has been.
+const RenderedFrame *RenderThread::GetFrame() const {
+  const RenderedFrame *frame = mFrames.GetFront();
+
+  return frame->serial > 0 ? frame : NULL;
+}
+
+void RenderThread::Run() {
+  while (true) {
+    {
+      unique_lock<mutex> lock(mMutex);
+      mWake.wait(lock, [this] { return mStopping || mScenes.HasUnread(); });
+      if (mStopping) {
+        return;
+      }
+    }
+    mScenes.Update();
+    const SceneSnapshot *scene = mScenes.GetFront();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (!mRasterizer || mRasterizer->GetWidth() != scene->width ||
+        mRasterizer->GetHeight() != scene->height) {
+      delete mRasterizer;
+      mRasterizer = new SoftwareRasterizer(scene->width, scene->height);
+      mRasterizer->SetThreadPool(mPool);
+    }
+    mRasterizer->SetView(scene->left, scene->bottom, scene->scale);
+    mRasterizer->SetClip(scene->clip);
+    mRasterizer->Clear(RENDER_BACKGROUND, RENDER_BACKGROUND,
+                       RENDER_BACKGROUND);
+    mRasterizer->Draw(scene->vertices, scene->runs);
+
+    RenderedFrame *frame = mFrames.GetBack();
+    frame->serial = scene->serial;
+    frame->width = scene->width;
+    frame->height = scene->height;
+    frame->pixels.assign(mRasterizer->GetPixels(), mRasterizer->GetPixels() +
+                                                   scene->width *
+                                                   scene->height * 3);
+    mDrawSeconds += chrono::duration<double>(
+                      chrono::steady_clock::now() - start).count();
+    frame->framesDrawn = ++mFramesDrawn;
+    frame->drawSeconds = mDrawSeconds;
+    mFrames.Publish();
+  }
+}
@@ -0,0 +1,106 @@
+/*******************************************************************************
+   Filename: renderthread.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for RenderThread, which rasterizes the drawing on a
+             thread of its own so a slow frame never holds up input. The
+             GLUT thread publishes snapshots of the damaged part of the scene
+             and the render thread publishes finished images, each through a
+             lock-free triple buffer: neither side ever waits for the other,
+             and each always sees the newest complete copy.
+*******************************************************************************/
+
+#ifndef RENDERTHREAD_H_
+#define RENDERTHREAD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "raster.h"
+
+// Three copies of a T shared by one writer and one reader. The writer fills
+// its back copy and publishes it, taking the previously published copy in
+// exchange; the reader swaps its front copy for the published one whenever
+// a fresh one is there. Unread copies are simply overwritten.
+template <class T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : mSlots(), mReady(1) {  // slots start zeroed
+    mBack = 0;
+    mFront = 2;
+  }
+  T *GetBack() { return &mSlots[mBack]; }
+  void Publish() { mBack = mReady.exchange(mBack | FRESH) & INDEX; }
+  // Whether a copy has been published that the reader hasn't taken.
+  bool HasUnread() const { return mReady.load() & FRESH; }
+  // Takes the newest published copy, if there is one the reader hasn't seen.
+  bool Update() {
+    if (!HasUnread()) {
+      return false;
+    }
+    mFront = mReady.exchange(mFront) & INDEX;
+
+    return true;
+  }
+  const T *GetFront() const { return &mSlots[mFront]; }
+ private:
+  static const int INDEX = 3;
+  static const int FRESH = 4;
+
+  T mSlots[3];
+  int mBack, mFront;  // owned by the writer and the reader respectively
+  atomic<int> mReady;  // the published copy's index, and FRESH until read
+};
+
+// The primitives that reach into a clip rectangle, which is all the render
+// thread redraws of its image.
+struct SceneSnapshot {
+  long serial;
+  int width, height;
+  double left, bottom, scale;
+  PixelRect clip;
+  vector<Vertex> vertices;
+  vector<DrawRun> runs;
+};
+
+struct RenderedFrame {
+  long serial;  // of the newest snapshot drawn into it; 0 for none yet
+  int width, height;
+  vector<unsigned char> pixels;  // RGB, bottom row first
+  long framesDrawn;     // by the render thread so far
+  double drawSeconds;   // spent drawing them
+};
+
+class RenderThread {
+ public:
+  RenderThread();
+  ~RenderThread();
+  // The snapshot the GLUT thread fills before calling PublishScene.
+  SceneSnapshot *GetScene() { return mScenes.GetBack(); }
+  bool IsScenePending() const { return mScenes.HasUnread(); }
+  long PublishScene();
+  bool HasNewFrame() const { return mFrames.HasUnread(); }
+  const RenderedFrame *TakeFrame();
+  const RenderedFrame *GetFrame() const;
+ private:
+  void Run();
+
+  TripleBuffer<SceneSnapshot> mScenes;
+  TripleBuffer<RenderedFrame> mFrames;
+  SoftwareRasterizer *mRasterizer;  // the image, kept between snapshots
+  // tiles are drawn on workers of the render thread's own, so a frame never
+  // holds the shared pool that loading and tessellation use meanwhile
+  ThreadPool *mPool;
+  long mSerial;
+  long mFramesDrawn;
+  double mDrawSeconds;
+  // only for sleeping while there is nothing to draw
+  mutex mMutex;
+  condition_variable mWake;
+  bool mStopping;
+  thread mThread;
+};
+
+#endif  // RENDERTHREAD_H_
@@ -0,0 +1,1041 @@
+/*******************************************************************************
+   Filename: savefile.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Functions that read and write save files in the text, binary and
+             compact formats. Every format is read into a SceneData, from
+             which the shapes are built; binary files are mapped into memory
+             and copied from the mapped shape table and coordinate arrays.
+*******************************************************************************/
+
+#include <charconv>
+#include <cmath>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "savefile.h"
+#include "journal.h"
+#include "threadpool.h"
+
+//
+// Memory-mapped files:
+//
+
+// Maps a whole file for reading, returning NULL if it can't be opened. An
+// empty file maps to an empty (but non-NULL) buffer.
+const char *MapFile(const char *filename, size_t *size) {
+  static const char empty[1] = {'\0'};
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return NULL;
+  }
+  *size = info.st_size;
+  if (*size == 0) {
+    close(fd);
+    return empty;
+  }
+  void *mapping = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    cerr << "Error: unable to map " << filename << "." << endl;
+    return NULL;
+  }
+  madvise(mapping, *size, MADV_SEQUENTIAL);
+
+  return (const char *) mapping;
+}
+
+void UnmapFile(const char *data, size_t size) {
+  if (size > 0) {
+    munmap((void *) data, size);
+  }
+}
+
+//
+// Text format:
+//
+
+static bool SaveText(const char *filename, const SceneData &data) {
+  ofstream fout(filename);
+  if (!fout.good()) {
+    cerr << "Error: unable to write " << filename << "." << endl;
+    return false;
+  }
+  int offset = 0;
+  for (int i = 0; i < (int) data.types.size(); ++i) {
+    fout << (int) data.types[i] << " ";
+    for (int j = offset; j < offset + data.counts[i]; ++j) {
+      fout << data.xs[j] << " ";
+      fout << data.ys[j] << " ";
+    }
+    offset += data.counts[i];
+    fout << UnpackRed(data.colors[i]) << " ";
+    fout << UnpackGreen(data.colors[i]) << " ";
+    fout << UnpackBlue(data.colors[i]) << " ";
+    fout << (bool) data.filled[i] << endl;
+  }
+  if (!data.pointXs.empty()) {
+    fout << NONE << " ";
+    for (int i = 0; i < (int) data.pointXs.size(); ++i) {
+      fout << data.pointXs[i] << " ";
+      fout << data.pointYs[i] << " ";
+    }
+    fout << endl;
+  }
+  fout.close();
+
+  return !fout.fail();
+}
+
+// Parses the numbers on one line of a text save file into numbers, returning
+// a pointer just past the line.
+static const char *ParseLine(const char *p, const char *end,
+                             vector<double> *numbers, bool *valid) {
+  numbers->clear();
+  *valid = true;
+  while (p < end && *p != '\n') {
+    if (*p == ' ' || *p == '\t' || *p == '\r') {
+      ++p;
+      continue;
+    }
+    double value;
+    from_chars_result result = from_chars(p, end, value);
+    if (result.ec != errc()) {
+      *valid = false;
+      while (p < end && *p != '\n') {
+        ++p;
+      }
+      break;
+    }
+    numbers->push_back(value);
+    p = result.ptr;
+  }
+
+  return p < end ? p + 1 : p;
+}
+
+// Parses a text save file held in memory. Each line holds a shape type, the
+// coordinates of its vertices, its color and whether it's filled; a line of
+// type NONE holds pending points. Parsing stops at the first invalid line.
+bool ParseTextScene(const char *begin, const char *end, SceneData *data) {
+  vector<double> numbers;
+  const char *p = begin;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+                       *p == '\n')) {
+      ++p;
+    }
+    if (p == end) {
+      break;
+    }
+    int type;
+    from_chars_result result = from_chars(p, end, type);
+    bool valid = result.ec == errc();
+    if (valid) {
+      p = ParseLine(result.ptr, end, &numbers, &valid);
+    }
+    int n = numbers.size();
+    if (valid && type == NONE) {
+      for (int i = 0; i + 1 < n; i += 2) {
+        data->pointXs.push_back(numbers[i]);
+        data->pointYs.push_back(numbers[i + 1]);
+      }
+    } else if (valid && n >= 4 && n % 2 == 0) {
+      for (int i = 0; i < n - 4; i += 2) {
+        data->xs.push_back(numbers[i]);
+        data->ys.push_back(numbers[i + 1]);
+      }
+      data->types.push_back(type);
+      data->counts.push_back((n - 4) / 2);
+      data->colors.push_back(PackColor(numbers[n - 4], numbers[n - 3],
+                                       numbers[n - 2]));
+      data->filled.push_back(numbers[n - 1] != 0.0);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Splits a text save file into chunks on line boundaries and parses them on
+// the thread pool, one SceneData per chunk in file order. As with a serial
+// parse, everything before the first invalid line is kept.
+bool ParseTextSceneInChunks(const char *begin, const char *end,
+                            vector<SceneData> *chunks) {
+  ThreadPool *pool = GetThreadPool();
+  size_t size = end - begin;
+  int numChunks = pool->NumThreads() * LOAD_CHUNKS_PER_THREAD;
+  if ((size_t) numChunks > size / MIN_LOAD_CHUNK_BYTES) {
+    numChunks = size / MIN_LOAD_CHUNK_BYTES;
+  }
+  if (numChunks < 1) {
+    numChunks = 1;
+  }
+  vector<const char *> bounds(numChunks + 1);
+  bounds[0] = begin;
+  bounds[numChunks] = end;
+  for (int k = 1; k < numChunks; ++k) {
+    const char *p = begin + size / numChunks * k;
+    if (p < bounds[k - 1]) {
+      p = bounds[k - 1];
+    }
+    const char *newline = (const char *) memchr(p, '\n', end - p);
+    bounds[k] = newline ? newline + 1 : end;
+  }
+
+  chunks->clear();
+  chunks->resize(numChunks);
+  vector<char> valid(numChunks);
+  pool->ParallelFor(numChunks, [&](int k) {
+    valid[k] = ParseTextScene(bounds[k], bounds[k + 1], &(*chunks)[k]);
+  });
+  for (int k = 0; k < numChunks; ++k) {
+    if (!valid[k]) {
+      chunks->resize(k + 1);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Builds the shapes and pending points described by parsed save-file data.
+// The shapes go into gScene in one AddRows call, which copies their columns
+// whole, and only the views onto the new rows are made one by one. Stops at
+// the first shape that can't be built, returning false, but keeps the shapes
+// before it.
+bool BuildScene(const SceneData &data,
+                vector<Shape *> *shapes, vector<Point2D *> *points) {
+  int numShapes = data.types.size(), numBuilt = 0;
+  bool cornersMissing = false;
+  while (numBuilt < numShapes &&
+         IsValidVertexCount((ShapeType) data.types[numBuilt],
+                            data.counts[numBuilt])) {
+    cornersMissing = cornersMissing ||
+                     (data.types[numBuilt] == RECTANGLE &&
+                      data.counts[numBuilt] == 2);
+    ++numBuilt;
+  }
+
+  // flags and colors as the shapes' constructors would set them
+  vector<unsigned char> flags(numBuilt);
+  vector<PackedColor> colors(numBuilt);
+  for (int i = 0; i < numBuilt; ++i) {
+    bool filled = data.filled[i] && data.types[i] != LINE &&
+                  data.types[i] != BEZIER_CURVE;
+    flags[i] = (filled ? SHAPE_FILLED : 0) | SHAPE_SELECTED | SHAPE_DIRTY;
+    colors[i] = data.colors[i] | 0xFF000000;
+  }
+
+  // a rectangle saved by two opposite corners gets the other two, as the
+  // Rectangle constructor adds them
+  const vector<int> *counts = &data.counts;
+  const vector<double> *xs = &data.xs, *ys = &data.ys;
+  vector<int> allCounts;
+  vector<double> allXs, allYs;
+  if (cornersMissing) {
+    int offset = 0;
+    for (int i = 0; i < numBuilt; ++i) {
+      int n = data.counts[i];
+      allXs.insert(allXs.end(), &data.xs[offset], &data.xs[offset] + n);
+      allYs.insert(allYs.end(), &data.ys[offset], &data.ys[offset] + n);
+      if (data.types[i] == RECTANGLE && n == 2) {
+        allXs.push_back(data.xs[offset]);
+        allYs.push_back(data.ys[offset + 1]);
+        allXs.push_back(data.xs[offset + 1]);
+        allYs.push_back(data.ys[offset]);
+        n = 4;
+      }
+      allCounts.push_back(n);
+      offset += data.counts[i];
+    }
+    counts = &allCounts;
+    xs = &allXs;
+    ys = &allYs;
+  }
+
+  if (numBuilt > 0) {
+    vector<ShapeHandle> handles(numBuilt);
+    gScene.AddRows(&data.types[0], &(*counts)[0], &colors[0], &flags[0],
+                   numBuilt, xs->empty() ? NULL : &(*xs)[0],
+                   ys->empty() ? NULL : &(*ys)[0], &handles[0]);
+    shapes->reserve(shapes->size() + numBuilt);
+    for (int i = 0; i < numBuilt; ++i) {
+      shapes->push_back(CreateShape(handles[i]));
+    }
+  }
+  if (numBuilt < numShapes) {
+    return false;
+  }
+  for (int i = 0; i < (int) data.pointXs.size(); ++i) {
+    points->push_back(new Point2D(data.pointXs[i], data.pointYs[i]));
+  }
+
+  return true;
+}
+
+static bool LoadText(const char *filename,
+                     vector<Shape *> *shapes, vector<Point2D *> *points) {
+  size_t size;
+  const char *text = MapFile(filename, &size);
+  if (!text) {
+    return false;
+  }
+  vector<SceneData> chunks;
+  bool valid = ParseTextSceneInChunks(text, text + size, &chunks);
+  UnmapFile(text, size);
+  int numShapes = 0, numVertices = 0;
+  vector<SceneData>::iterator iter;
+  for (iter = chunks.begin(); iter < chunks.end(); ++iter) {
+    numShapes += iter->types.size();
+    numVertices += iter->xs.size();
+  }
+  gScene.Reserve(gScene.NumShapes() + numShapes,
+                 gScene.NumVertices() + numVertices);
+  bool built = true;
+  for (iter = chunks.begin(); built && iter < chunks.end(); ++iter) {
+    built = BuildScene(*iter, shapes, points);
+  }
+  valid = valid && built;
+  if (!valid) {
+    cerr << "Error: invalid data stored in save file." << endl;
+  }
+
+  return valid;
+}
+
+//
+// Binary format:
+//
+
+static bool SaveBinary(const char *filename, const SceneData &data) {
+  BinarySaveHeader header;
+  vector<BinaryShapeRecord> records(data.types.size());
+  uint64_t offset = 0;
+  for (int i = 0; i < (int) records.size(); ++i) {
+    BinaryShapeRecord &record = records[i];
+    memset(&record, 0, sizeof(record));
+    record.firstVertex = offset;
+    record.numVertices = data.counts[i];
+    record.color = data.colors[i];
+    record.type = data.types[i];
+    record.filled = data.filled[i];
+    offset += data.counts[i];
+  }
+  vector<double> xs(data.xs), ys(data.ys);
+  xs.insert(xs.end(), data.pointXs.begin(), data.pointXs.end());
+  ys.insert(ys.end(), data.pointYs.begin(), data.pointYs.end());
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_SAVE_MAGIC, sizeof(header.magic));
+  header.version = BINARY_SAVE_VERSION;
+  header.byteOrderMark = BINARY_BYTE_ORDER_MARK;
+  header.headerSize = sizeof(BinarySaveHeader);
+  header.shapeRecordSize = sizeof(BinaryShapeRecord);
+  header.numShapes = records.size();
+  header.numVertices = xs.size();
+  header.numPendingPoints = data.pointXs.size();
+  header.shapeTableOffset = sizeof(BinarySaveHeader);
+  header.xsOffset = header.shapeTableOffset +
+                    records.size() * sizeof(BinaryShapeRecord);
+  header.ysOffset = header.xsOffset + xs.size() * sizeof(double);
+
+  ofstream fout(filename, ios::binary);
+  if (!fout.good()) {
+    cerr << "Error: unable to write " << filename << "." << endl;
+    return false;
+  }
+  fout.write((const char *) &header, sizeof(header));
+  if (!records.empty()) {
+    fout.write((const char *) &records[0],
+               records.size() * sizeof(BinaryShapeRecord));
+  }
+  if (!xs.empty()) {
+    fout.write((const char *) &xs[0], xs.size() * sizeof(double));
+    fout.write((const char *) &ys[0], ys.size() * sizeof(double));
+  }
+  fout.close();
+
+  return !fout.fail();
+}
+
+// Checks that every table and array the header describes lies inside the
+// file, so nothing read from the mapping can run off its end.
+static bool IsValidBinaryHeader(const BinarySaveHeader &header,
+                                uint64_t fileSize) {
+  if (memcmp(header.magic, BINARY_SAVE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.byteOrderMark != BINARY_BYTE_ORDER_MARK) {
+    return false;
+  }
+  if (header.version > BINARY_SAVE_VERSION) {
+    cerr << "Error: save file version " << header.version
+         << " is newer than this program supports." << endl;
+    return false;
+  }
+  if (header.headerSize < sizeof(BinarySaveHeader) ||
+      header.shapeRecordSize < sizeof(BinaryShapeRecord) ||
+      header.numPendingPoints > header.numVertices) {
+    return false;
+  }
+  uint64_t arraySize = header.numVertices * sizeof(double);
+  return header.numShapes <= fileSize / header.shapeRecordSize &&
+         header.numVertices <= fileSize / sizeof(double) &&
+         header.shapeTableOffset <= fileSize &&
+         header.numShapes * header.shapeRecordSize <=
+           fileSize - header.shapeTableOffset &&
+         header.xsOffset <= fileSize &&
+         arraySize <= fileSize - header.xsOffset &&
+         header.ysOffset <= fileSize &&
+         arraySize <= fileSize - header.ysOffset &&
+         header.xsOffset % sizeof(double) == 0 &&
+         header.ysOffset % sizeof(double) == 0;
+}
+
+// Copies the shapes and pending points of a mapped binary save file into
+// data, checking every offset and count first so nothing read can run off the
+// end of the file.
+static bool ReadBinaryScene(const char *base, size_t fileSize,
+                            SceneData *data) {
+  if (fileSize < sizeof(BinarySaveHeader)) {
+    return false;
+  }
+  const BinarySaveHeader &header = *(const BinarySaveHeader *) base;
+  if (!IsValidBinaryHeader(header, fileSize)) {
+    return false;
+  }
+  const double *xs = (const double *) (base + header.xsOffset);
+  const double *ys = (const double *) (base + header.ysOffset);
+  uint64_t numShapeVertices = header.numVertices - header.numPendingPoints;
+  for (uint64_t i = 0; i < header.numShapes; ++i) {
+    const BinaryShapeRecord &record = *(const BinaryShapeRecord *)
+      (base + header.shapeTableOffset + i * header.shapeRecordSize);
+    if (record.firstVertex > numShapeVertices ||
+        record.numVertices > numShapeVertices - record.firstVertex) {
+      return false;
+    }
+    data->types.push_back(record.type);
+    data->counts.push_back(record.numVertices);
+    data->colors.push_back(record.color);
+    data->filled.push_back(record.filled != 0);
+    data->xs.insert(data->xs.end(), xs + record.firstVertex,
+                    xs + record.firstVertex + record.numVertices);
+    data->ys.insert(data->ys.end(), ys + record.firstVertex,
+                    ys + record.firstVertex + record.numVertices);
+  }
+  data->pointXs.assign(xs + numShapeVertices, xs + header.numVertices);
+  data->pointYs.assign(ys + numShapeVertices, ys + header.numVertices);
+
+  return true;
+}
+
+static bool LoadBinary(const char *filename,
+                       vector<Shape *> *shapes, vector<Point2D *> *points) {
+  size_t size;
+  const char *base = MapFile(filename, &size);
+  if (!base) {
+    return false;
+  }
+  SceneData data;
+  bool valid = ReadBinaryScene(base, size, &data);
+  UnmapFile(base, size);
+  if (!valid) {
+    cerr << "Error: invalid data stored in save file." << endl;
+    return false;
+  }
+  gScene.Reserve(gScene.NumShapes() + data.types.size(),
+                 gScene.NumVertices() + data.xs.size());
+  if (!BuildScene(data, shapes, points)) {
+    cerr << "Error: invalid data stored in save file." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//
+// Compact format:
+//
+
+static double gSaveGrid = DEFAULT_SAVE_GRID;
+
+// Sets the spacing of the grid the compact format snaps coordinates to. Only
+// takes effect for saves started afterward.
+double SetSaveGrid(double grid) {
+  if (grid > 0.0) {
+    gSaveGrid = grid;
+  }
+
+  return gSaveGrid;
+}
+
+double GetSaveGrid() {
+  return gSaveGrid;
+}
+
+static void AppendVarint(string *out, uint64_t value) {
+  while (value >= 0x80) {
+    *out += (char) (value | 0x80);
+    value >>= 7;
+  }
+  *out += (char) value;
+}
+
+static bool ReadVarint(const char **p, const char *end, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*p == end) {
+      return false;
+    }
+    unsigned char byte = *(*p)++;
+    *value |= (uint64_t) (byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Maps signed differences to unsigned ones so that small negative numbers,
+// like small positive ones, take a single varint byte.
+static uint64_t ZigZag(int64_t value) {
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value) {
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static int64_t Quantize(double value, double grid) {
+  const double limit = 4.0e18;
+  double units = value / grid;
+  if (!(units > -limit)) {
+    units = -limit;
+  } else if (units > limit) {
+    units = limit;
+  }
+
+  return llround(units);
+}
+
+// Appends the (dx, dy) pairs for n vertices, continuing from *x and *y.
+// Differences wrap around rather than overflow, and decoding wraps the same
+// way, so even extreme coordinates come back as they were quantized.
+static void AppendDeltas(string *out, const double *xs, const double *ys,
+                         int n, double grid, int64_t *x, int64_t *y) {
+  for (int i = 0; i < n; ++i) {
+    int64_t qx = Quantize(xs[i], grid);
+    int64_t qy = Quantize(ys[i], grid);
+    AppendVarint(out, ZigZag((int64_t) ((uint64_t) qx - (uint64_t) *x)));
+    AppendVarint(out, ZigZag((int64_t) ((uint64_t) qy - (uint64_t) *y)));
+    *x = qx;
+    *y = qy;
+  }
+}
+
+static bool ReadDeltas(const char **p, const char *end, uint64_t n,
+                       double grid, int64_t *x, int64_t *y,
+                       vector<double> *xs, vector<double> *ys) {
+  for (uint64_t i = 0; i < n; ++i) {
+    uint64_t dx, dy;
+    if (!ReadVarint(p, end, &dx) || !ReadVarint(p, end, &dy)) {
+      return false;
+    }
+    *x = (int64_t) ((uint64_t) *x + (uint64_t) UnZigZag(dx));
+    *y = (int64_t) ((uint64_t) *y + (uint64_t) UnZigZag(dy));
+    xs->push_back(*x * grid);
+    ys->push_back(*y * grid);
+  }
+
+  return true;
+}
+
+void EncodeCompactScene(const SceneData &data, double grid, string *out) {
+  out->assign(COMPACT_SAVE_MAGIC, sizeof(COMPACT_SAVE_MAGIC));
+  AppendVarint(out, COMPACT_SAVE_VERSION);
+  out->append((const char *) &grid, sizeof(grid));
+
+  vector<PackedColor> palette;
+  vector<int> colorIndices(data.colors.size());
+  unordered_map<PackedColor, int> paletteIndices;
+  for (int i = 0; i < (int) data.colors.size(); ++i) {
+    PackedColor rgb = data.colors[i] & 0xFFFFFF;
+    unordered_map<PackedColor, int>::iterator iter =
+      paletteIndices.find(rgb);
+    if (iter == paletteIndices.end()) {
+      iter = paletteIndices.insert(make_pair(rgb, palette.size())).first;
+      palette.push_back(rgb);
+    }
+    colorIndices[i] = iter->second;
+  }
+  AppendVarint(out, palette.size());
+  for (int i = 0; i < (int) palette.size(); ++i) {
+    *out += (char) (palette[i] & 0xFF);
+    *out += (char) (palette[i] >> 8 & 0xFF);
+    *out += (char) (palette[i] >> 16 & 0xFF);
+  }
+
+  int64_t x = 0, y = 0;
+  int offset = 0;
+  AppendVarint(out, data.types.size());
+  for (int i = 0; i < (int) data.types.size(); ++i) {
+    *out += (char) (data.types[i] << 1 | (data.filled[i] ? 1 : 0));
+    AppendVarint(out, colorIndices[i]);
+    AppendVarint(out, data.counts[i]);
+    AppendDeltas(out, &data.xs[offset], &data.ys[offset], data.counts[i],
+                 grid, &x, &y);
+    offset += data.counts[i];
+  }
+  AppendVarint(out, data.pointXs.size());
+  if (!data.pointXs.empty()) {
+    AppendDeltas(out, &data.pointXs[0], &data.pointYs[0],
+                 data.pointXs.size(), grid, &x, &y);
+  }
+}
+
+// Decodes a compact save file held in memory. Every count is checked against
+// the bytes left before anything is allocated for it, so a damaged file
+// can't ask for more memory than its own size suggests.
+bool DecodeCompactScene(const char *begin, const char *end, SceneData *data) {
+  const char *p = begin;
+  uint64_t version, numColors, numShapes, numPoints;
+  double grid;
+  if (end - p < (ptrdiff_t) sizeof(COMPACT_SAVE_MAGIC) ||
+      memcmp(p, COMPACT_SAVE_MAGIC, sizeof(COMPACT_SAVE_MAGIC)) != 0) {
+    return false;
+  }
+  p += sizeof(COMPACT_SAVE_MAGIC);
+  if (!ReadVarint(&p, end, &version) || version != COMPACT_SAVE_VERSION ||
+      end - p < (ptrdiff_t) sizeof(grid)) {
+    return false;
+  }
+  memcpy(&grid, p, sizeof(grid));
+  p += sizeof(grid);
+  if (!(grid > 0.0) || !ReadVarint(&p, end, &numColors) ||
+      numColors > (uint64_t) (end - p) / 3) {
+    return false;
+  }
+  vector<PackedColor> palette(numColors);
+  for (uint64_t i = 0; i < numColors; ++i) {
+    const unsigned char *rgb = (const unsigned char *) p;
+    palette[i] = rgb[0] | rgb[1] << 8 | rgb[2] << 16 | 0xFF000000;
+    p += 3;
+  }
+
+  int64_t x = 0, y = 0;
+  if (!ReadVarint(&p, end, &numShapes) ||
+      numShapes > (uint64_t) (end - p) / 3) {
+    return false;
+  }
+  data->types.reserve(data->types.size() + numShapes);
+  data->counts.reserve(data->counts.size() + numShapes);
+  data->colors.reserve(data->colors.size() + numShapes);
+  data->filled.reserve(data->filled.size() + numShapes);
+  for (uint64_t i = 0; i < numShapes; ++i) {
+    uint64_t colorIndex, numVertices;
+    if (p == end) {
+      return false;
+    }
+    unsigned char typeAndFill = *p++;
+    if (!ReadVarint(&p, end, &colorIndex) || colorIndex >= numColors ||
+        !ReadVarint(&p, end, &numVertices) ||
+        numVertices > (uint64_t) (end - p) / 2 ||
+        !ReadDeltas(&p, end, numVertices, grid, &x, &y,
+                    &data->xs, &data->ys)) {
+      return false;
+    }
+    data->types.push_back(typeAndFill >> 1);
+    data->counts.push_back(numVertices);
+    data->colors.push_back(palette[colorIndex]);
+    data->filled.push_back(typeAndFill & 1);
+  }
+  if (!ReadVarint(&p, end, &numPoints) ||
+      numPoints > (uint64_t) (end - p) / 2 ||
+      !ReadDeltas(&p, end, numPoints, grid, &x, &y,
+                  &data->pointXs, &data->pointYs)) {
+    return false;
+  }
+
+  return p == end;
+}
+
+static bool SaveCompact(const char *filename, const SceneData &data) {
+  string encoded;
+  EncodeCompactScene(data, gSaveGrid, &encoded);
+  ofstream fout(filename, ios::binary);
+  if (!fout.good()) {
+    cerr << "Error: unable to write " << filename << "." << endl;
+    return false;
+  }
+  fout.write(encoded.data(), encoded.size());
+  fout.close();
+
+  return !fout.fail();
+}
+
+static bool LoadCompact(const char *filename,
+                        vector<Shape *> *shapes, vector<Point2D *> *points) {
+  size_t size;
+  const char *encoded = MapFile(filename, &size);
+  if (!encoded) {
+    return false;
+  }
+  SceneData data;
+  bool valid = DecodeCompactScene(encoded, encoded + size, &data);
+  UnmapFile(encoded, size);
+  if (!valid) {
+    cerr << "Error: invalid data stored in save file." << endl;
+    return false;
+  }
+  gScene.Reserve(gScene.NumShapes() + data.types.size(),
+                 gScene.NumVertices() + data.xs.size());
+  if (!BuildScene(data, shapes, points)) {
+    cerr << "Error: invalid data stored in save file." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//
+// Format-independent functions:
+//
+
+// Copies the finished shapes and pending points of a drawing into data, which
+// can then be written without touching the shapes again.
+void SnapshotScene(const vector<Shape *> &shapes,
+                   const vector<Point2D *> &points, SceneData *data) {
+  int numVertices = 0;
+  vector<Shape *>::const_iterator shapeIter;
+  for (shapeIter = shapes.begin(); shapeIter < shapes.end(); ++shapeIter) {
+    numVertices += (*shapeIter)->NumPoints();
+  }
+  data->types.resize(shapes.size());
+  data->counts.resize(shapes.size());
+  data->colors.resize(shapes.size());
+  data->filled.resize(shapes.size());
+  data->xs.resize(numVertices);
+  data->ys.resize(numVertices);
+  int offset = 0;
+  for (int i = 0; i < (int) shapes.size(); ++i) {
+    const Shape *shape = shapes[i];
+    int n = shape->NumPoints();
+    data->types[i] = shape->GetShapeType();
+    data->counts[i] = n;
+    data->colors[i] = shape->GetColor();
+    data->filled[i] = shape->IsFilled();
+    for (int j = 0; j < n; ++j) {
+      data->xs[offset + j] = shape->GetX(j);
+      data->ys[offset + j] = shape->GetY(j);
+    }
+    offset += n;
+  }
+  data->pointXs.resize(points.size());
+  data->pointYs.resize(points.size());
+  for (int i = 0; i < (int) points.size(); ++i) {
+    data->pointXs[i] = points[i]->GetX();
+    data->pointYs[i] = points[i]->GetY();
+  }
+}
+
+bool WriteScene(const char *filename, SaveFormat format,
+                const SceneData &data) {
+  if (format == BINARY_SAVE_FORMAT) {
+    return SaveBinary(filename, data);
+  } else if (format == COMPACT_SAVE_FORMAT) {
+    return SaveCompact(filename, data);
+  }
+
+  return SaveText(filename, data);
+}
+
+// Writes to a temporary file beside filename, flushes it to disk and renames
+// it into place, so a crash part-way through never leaves a truncated file.
+bool WriteSceneAtomically(const char *filename, SaveFormat format,
+                          const SceneData &data) {
+  string temp = string(filename) + ".tmp";
+  if (!WriteScene(temp.c_str(), format, data)) {
+    unlink(temp.c_str());
+    return false;
+  }
+  int fd = open(temp.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+  if (rename(temp.c_str(), filename) != 0) {
+    cerr << "Error: unable to replace " << filename << "." << endl;
+    unlink(temp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// Writes the finished shapes and pending points of a drawing.
+bool SaveScene(const char *filename, SaveFormat format,
+               const vector<Shape *> &shapes,
+               const vector<Point2D *> &points) {
+  SceneData data;
+  SnapshotScene(shapes, points, &data);
+
+  return WriteScene(filename, format, data);
+}
+
+// Appends the shapes and pending points stored in a save file of any format.
+// Returns false if the file can't be read or holds invalid data.
+bool LoadScene(const char *filename,
+               vector<Shape *> *shapes, vector<Point2D *> *points) {
+  switch (GetSaveFileFormat(filename)) {
+    case BINARY_SAVE_FORMAT:
+      return LoadBinary(filename, shapes, points);
+    case COMPACT_SAVE_FORMAT:
+      return LoadCompact(filename, shapes, points);
+    default:
+      return LoadText(filename, shapes, points);
+  }
+}
+
+// Whether BuildScene can build every shape in data.
+static bool IsBuildable(const SceneData &data) {
+  for (int i = 0; i < (int) data.types.size(); ++i) {
+    if (!IsValidVertexCount((ShapeType) data.types[i], data.counts[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Appends one chunk of a text save file, as parsed, to the rest.
+static void AppendSceneData(const SceneData &chunk, SceneData *data) {
+  data->types.insert(data->types.end(), chunk.types.begin(),
+                     chunk.types.end());
+  data->counts.insert(data->counts.end(), chunk.counts.begin(),
+                      chunk.counts.end());
+  data->colors.insert(data->colors.end(), chunk.colors.begin(),
+                      chunk.colors.end());
+  data->filled.insert(data->filled.end(), chunk.filled.begin(),
+                      chunk.filled.end());
+  data->xs.insert(data->xs.end(), chunk.xs.begin(), chunk.xs.end());
+  data->ys.insert(data->ys.end(), chunk.ys.begin(), chunk.ys.end());
+  data->pointXs.insert(data->pointXs.end(), chunk.pointXs.begin(),
+                       chunk.pointXs.end());
+  data->pointYs.insert(data->pointYs.end(), chunk.pointYs.begin(),
+                       chunk.pointYs.end());
+}
+
+// Reads a save file of any format into data without building any shapes, so
+// unlike LoadScene it may be called from several threads at once. Returns
+// false if the file can't be read or holds anything BuildScene would reject,
+// so that a drawing can be checked in full before the old one is cleared.
+// Text files are parsed in chunks on the thread pool, as LoadText does.
+bool LoadSceneData(const char *filename, SceneData *data) {
+  size_t size;
+  const char *contents = MapFile(filename, &size);
+  if (!contents) {
+    return false;
+  }
+  bool valid;
+  switch (GetSaveFileFormat(filename)) {
+    case BINARY_SAVE_FORMAT:
+      valid = ReadBinaryScene(contents, size, data);
+      break;
+    case COMPACT_SAVE_FORMAT:
+      valid = DecodeCompactScene(contents, contents + size, data);
+      break;
+    default: {
+      vector<SceneData> chunks;
+      valid = ParseTextSceneInChunks(contents, contents + size, &chunks);
+      vector<SceneData>::iterator iter;
+      for (iter = chunks.begin(); iter < chunks.end(); ++iter) {
+        AppendSceneData(*iter, data);
+      }
+      break;
+    }
+  }
+  UnmapFile(contents, size);
+
+  return valid && IsBuildable(*data);
+}
+
+// Tells the formats apart by their first eight bytes; text is anything
+// without a known magic string.
+SaveFormat GetSaveFileFormat(const char *filename) {
+  char magic[sizeof(BINARY_SAVE_MAGIC)];
+  ifstream fin(filename, ios::binary);
+  fin.read(magic, sizeof(magic));
+  if (fin.good() && memcmp(magic, BINARY_SAVE_MAGIC, sizeof(magic)) == 0) {
+    return BINARY_SAVE_FORMAT;
+  } else if (fin.good() &&
+             memcmp(magic, COMPACT_SAVE_MAGIC, sizeof(magic)) == 0) {
+    return COMPACT_SAVE_FORMAT;
+  }
+
+  return TEXT_SAVE_FORMAT;
+}
+
+// Returns the format with the given name, or NUM_SAVE_FORMATS if none has it.
+SaveFormat ParseSaveFormat(const char *name) {
+  for (int i = 0; i < NUM_SAVE_FORMATS; ++i) {
+    if (strcmp(name, SAVE_FORMAT_NAMES[i]) == 0) {
+      return (SaveFormat) i;
+    }
+  }
+
+  return NUM_SAVE_FORMATS;
+}
+
+// Rewrites a save file in the given format, for the --convert command-line
+// option. If format is NUM_SAVE_FORMATS, text files become binary and other
+// files become text. Returns the process exit status.
+int ConvertSaveFile(const char *inFilename, const char *outFilename,
+                    SaveFormat format) {
+  vector<Shape *> shapes;
+  vector<Point2D *> points;
+  SaveFormat inFormat = GetSaveFileFormat(inFilename);
+  if (format == NUM_SAVE_FORMATS) {
+    format = inFormat == TEXT_SAVE_FORMAT ? BINARY_SAVE_FORMAT :
+                                            TEXT_SAVE_FORMAT;
+  }
+  if (!LoadScene(inFilename, &shapes, &points)) {
+    cerr << "Error: unable to read " << inFilename << "." << endl;
+    return 1;
+  }
+  if (!SaveScene(outFilename, format, shapes, points)) {
+    return 1;
+  }
+  cout << inFilename << " (" << SAVE_FORMAT_NAMES[inFormat] << ") -> "
+       << outFilename << " (" << SAVE_FORMAT_NAMES[format] << "): "
+       << shapes.size() << " shapes, " << points.size()
+       << " pending points" << endl;
+
+  return 0;
+}
+
+//
+// BackgroundSaver methods:
+//
+
+BackgroundSaver::BackgroundSaver() {
+  mPending = NULL;
+  mBusy = false;
+  mStopping = false;
+  mJournalBroken = false;
+  mStatus = SAVE_IDLE;
+}
+
+// Lets a save that is still being written finish before the program exits.
+BackgroundSaver::~BackgroundSaver() {
+  if (mThread.joinable()) {
+    {
+      lock_guard<mutex> lock(mMutex);
+      mStopping = true;
+    }
+    mWake.notify_all();
+    mThread.join();
+  }
+  delete mPending;
+}
+
+// Queues a snapshot to be written to filename, taking ownership of it. If a
+// save is already being written, this one follows it; a snapshot still
+// waiting its turn is replaced, since only the latest matters, and so are any
+// journal records waiting, since the snapshot already holds their edits.
+void BackgroundSaver::Save(const char *filename, SaveFormat format,
+                           SceneData *snapshot) {
+  {
+    lock_guard<mutex> lock(mMutex);
+    delete mPending;
+    mPending = snapshot;
+    mPendingFilename = filename;
+    mPendingFormat = format;
+    mPendingRecords.clear();
+    mStatus = SAVE_IN_PROGRESS;
+  }
+  Start();
+}
+
+// Queues journal records to be appended to filename's journal once any
+// snapshot ahead of them has been written. With no records (nothing has
+// changed since the last save) there is nothing to wait for, so an idle
+// saver just reports how its last write went.
+void BackgroundSaver::Append(const char *filename, const string &records) {
+  {
+    lock_guard<mutex> lock(mMutex);
+    if (records.empty()) {
+      if (!mPending && mPendingRecords.empty() && !mBusy) {
+        mStatus = mJournalBroken ? SAVE_FAILED : SAVE_SUCCEEDED;
+      }
+      return;
+    }
+    mPendingRecords += records;
+    mRecordsFilename = filename;
+    mStatus = SAVE_IN_PROGRESS;
+  }
+  Start();
+}
+
+// Blocks until every queued save has been written.
+void BackgroundSaver::Wait() {
+  unique_lock<mutex> lock(mMutex);
+  mIdle.wait(lock, [this] {
+    return !mPending && mPendingRecords.empty() && !mBusy;
+  });
+}
+
+void BackgroundSaver::Start() {
+  if (!mThread.joinable()) {
+    mThread = thread(&BackgroundSaver::WriterLoop, this);
+  }
+  mWake.notify_all();
+}
+
+// Writes a full snapshot (followed by a fresh, empty journal) if one is
+// queued, otherwise appends the queued journal records.
+void BackgroundSaver::WriterLoop() {
+  unique_lock<mutex> lock(mMutex);
+  while (true) {
+    mWake.wait(lock, [this] {
+      return mPending || !mPendingRecords.empty() || mStopping;
+    });
+    bool saved;
+    if (mPending) {
+      SceneData *snapshot = mPending;
+      string filename = mPendingFilename;
+      SaveFormat format = mPendingFormat;
+      mPending = NULL;
+      mBusy = true;
+      lock.unlock();
+      saved = WriteSceneAtomically(filename.c_str(), format, *snapshot) &&
+              WriteJournalHeader(filename.c_str());
+      mJournalBroken = !saved;
+      delete snapshot;
+    } else if (!mPendingRecords.empty()) {
+      string records, filename = mRecordsFilename;
+      records.swap(mPendingRecords);
+      mBusy = true;
+      lock.unlock();
+      // records are only meaningful after all of those before them
+      saved = !mJournalBroken && AppendJournal(filename.c_str(), records);
+      mJournalBroken = !saved;
+    } else {
+      return;
+    }
+    lock.lock();
+    mBusy = false;
+    if (!mPending && mPendingRecords.empty()) {
+      mStatus = saved ? SAVE_SUCCEEDED : SAVE_FAILED;
+    }
+    mIdle.notify_all();
+  }
+}
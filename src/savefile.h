@@ -0,0 +1,161 @@
+/*******************************************************************************
+   Filename: savefile.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for reading and writing save files. The original
+             text format (one shape per line) is still the default; the binary
+             format holds a header, a table of shapes and the coordinates of
+             every vertex in two contiguous arrays, so a loader can map the
+             file and build the scene without parsing it; the compact format
+             stores coordinates snapped to a grid as varint deltas and colors
+             as indices into a palette, for the smallest files.
+*******************************************************************************/
+
+#ifndef SAVEFILE_H_
+#define SAVEFILE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "shapes.h"
+
+enum SaveFormat {
+  TEXT_SAVE_FORMAT,
+  BINARY_SAVE_FORMAT,
+  COMPACT_SAVE_FORMAT,
+
+  NUM_SAVE_FORMATS
+};
+
+const char *const SAVE_FORMAT_NAMES[NUM_SAVE_FORMATS] = {
+  "text", "binary", "compact"
+};
+
+const char SAVE_FILE_NAME[] = "savefile";
+const int LOAD_CHUNKS_PER_THREAD = 4;
+const size_t MIN_LOAD_CHUNK_BYTES = 256 * 1024;
+
+const char BINARY_SAVE_MAGIC[8] = {'D', 'R', 'A', 'W', 'B', 'I', 'N', '\0'};
+const uint32_t BINARY_SAVE_VERSION = 1;
+const uint32_t BINARY_BYTE_ORDER_MARK = 0x01020304;
+
+const char COMPACT_SAVE_MAGIC[8] = {'D', 'R', 'A', 'W', 'C', 'M', 'P', '\0'};
+const uint32_t COMPACT_SAVE_VERSION = 1;
+const double DEFAULT_SAVE_GRID = 1.0;  // mouse() positions are whole pixels
+
+// Every field is stored in the byte order of the machine that wrote it, which
+// byteOrderMark lets a reader check. Offsets are from the start of the file.
+struct BinarySaveHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint32_t headerSize;
+  uint32_t shapeRecordSize;
+  uint64_t numShapes;
+  uint64_t numVertices;       // shape vertices, then pending points
+  uint64_t numPendingPoints;
+  uint64_t shapeTableOffset;  // numShapes BinaryShapeRecords
+  uint64_t xsOffset;          // numVertices doubles
+  uint64_t ysOffset;          // numVertices doubles
+};
+
+struct BinaryShapeRecord {
+  uint64_t firstVertex;
+  uint32_t numVertices;
+  uint32_t color;  // PackedColor
+  uint8_t type;    // ShapeType
+  uint8_t filled;
+  uint8_t reserved[6];
+};
+
+// A drawing as parsed from a save file, before any shapes are built: one
+// entry per shape in each per-shape column and every vertex in xs and ys.
+struct SceneData {
+  vector<unsigned char> types;
+  vector<int> counts;
+  vector<PackedColor> colors;
+  vector<unsigned char> filled;
+  vector<double> xs, ys;
+  vector<double> pointXs, pointYs;  // pending points
+};
+
+// Compact format: the magic string, then a varint version and the grid
+// spacing as a raw double, then varints throughout:
+//
+//   palette:  numColors, then each color as three bytes (red, green, blue)
+//   shapes:   numShapes, then for each a byte (type << 1 | filled), a
+//             palette index, numVertices and that many (dx, dy) pairs
+//   points:   numPendingPoints, then that many (dx, dy) pairs
+//
+// Each coordinate is stored in grid units as a zigzag-encoded difference from
+// the vertex before it (shapes and pending points form a single run starting
+// at 0, 0), so nearby vertices take a byte or two each.
+
+const char *MapFile(const char *filename, size_t *size);
+void UnmapFile(const char *data, size_t size);
+bool ParseTextScene(const char *begin, const char *end, SceneData *data);
+bool ParseTextSceneInChunks(const char *begin, const char *end,
+                            vector<SceneData> *chunks);
+bool BuildScene(const SceneData &data,
+                vector<Shape *> *shapes, vector<Point2D *> *points);
+void EncodeCompactScene(const SceneData &data, double grid, string *out);
+bool DecodeCompactScene(const char *begin, const char *end, SceneData *data);
+double SetSaveGrid(double grid);
+double GetSaveGrid();
+void SnapshotScene(const vector<Shape *> &shapes,
+                   const vector<Point2D *> &points, SceneData *data);
+bool WriteScene(const char *filename, SaveFormat format,
+                const SceneData &data);
+bool WriteSceneAtomically(const char *filename, SaveFormat format,
+                          const SceneData &data);
+bool SaveScene(const char *filename, SaveFormat format,
+               const vector<Shape *> &shapes,
+               const vector<Point2D *> &points);
+bool LoadScene(const char *filename,
+               vector<Shape *> *shapes, vector<Point2D *> *points);
+bool LoadSceneData(const char *filename, SceneData *data);
+SaveFormat GetSaveFileFormat(const char *filename);
+SaveFormat ParseSaveFormat(const char *name);
+int ConvertSaveFile(const char *inFilename, const char *outFilename,
+                    SaveFormat format);
+
+enum SaveStatus {
+  SAVE_IDLE,
+  SAVE_IN_PROGRESS,
+  SAVE_SUCCEEDED,
+  SAVE_FAILED
+};
+
+// Writes scene snapshots and journal records on a thread of its own so that
+// saving never holds up input or drawing.
+class BackgroundSaver {
+ public:
+  BackgroundSaver();
+  ~BackgroundSaver();
+  void Save(const char *filename, SaveFormat format, SceneData *snapshot);
+  void Append(const char *filename, const string &records);
+  void Wait();
+  SaveStatus GetStatus() const { return mStatus; }
+ private:
+  void Start();
+  void WriterLoop();
+
+  thread mThread;
+  mutex mMutex;
+  condition_variable mWake, mIdle;
+  SceneData *mPending;  // the next snapshot to write, if any
+  string mPendingFilename;
+  SaveFormat mPendingFormat;
+  string mPendingRecords;  // journal records to append after any snapshot
+  string mRecordsFilename;
+  bool mBusy;
+  bool mStopping;
+  bool mJournalBroken;  // set by a failed write until a snapshot succeeds
+  atomic<SaveStatus> mStatus;
+};
+
+#endif  // SAVEFILE_H_
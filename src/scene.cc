@@ -0,0 +1,215 @@
+/*******************************************************************************
+   Filename: scene.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for SceneStore. Each shape's vertices occupy
+             a run of the coordinate arrays, and runs are kept in drawing
+             order. Removing the last shape just truncates the arrays; runs
+             freed elsewhere are left in place until they outweigh the live
+             vertices, then squeezed out in one pass.
+*******************************************************************************/
+
+#include "scene.h"
+
+SceneStore gScene;
+SceneStore gPanelScene;
+
+static unsigned int PackChannel(double c) {
+  return (unsigned int) (c < 0.0 ? 0 : c > 1.0 ? 255 : c * 255.0 + 0.5);
+}
+
+PackedColor PackColor(double r, double g, double b) {
+  return PackChannel(r) | PackChannel(g) << 8 | PackChannel(b) << 16 |
+         0xFF000000;
+}
+
+double UnpackRed(PackedColor color) {
+  return (color & 0xFF) / 255.0;
+}
+
+double UnpackGreen(PackedColor color) {
+  return (color >> 8 & 0xFF) / 255.0;
+}
+
+double UnpackBlue(PackedColor color) {
+  return (color >> 16 & 0xFF) / 255.0;
+}
+
+SceneStore::SceneStore() {
+  mNextGeneration = 1;
+  mGarbage = 0;
+}
+
+ShapeHandle SceneStore::Add(ShapeType type,
+                            const double *xs, const double *ys, int n,
+                            PackedColor color, unsigned char flags) {
+  ShapeHandle handle;
+  if (mFreeSlots.empty()) {
+    handle.slot = mSlotRows.size();
+    mSlotRows.push_back(-1);
+    mSlotGenerations.push_back(0);
+  } else {
+    handle.slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+  }
+  handle.generation = mNextGeneration++;
+  mSlotRows[handle.slot] = mTypes.size();
+  mSlotGenerations[handle.slot] = handle.generation;
+
+  mOffsets.push_back(mXs.size());
+  mCounts.push_back(n);
+  mTypes.push_back(type);
+  mColors.push_back(color);
+  mFlags.push_back(flags);
+  mRowSlots.push_back(handle.slot);
+  mXs.insert(mXs.end(), xs, xs + n);
+  mYs.insert(mYs.end(), ys, ys + n);
+
+  return handle;
+}
+
+// Appends numShapes shapes at once, as loading does: each per-shape column is
+// copied whole, as are the vertices, which are counts[i] per shape in order.
+// The new shapes' handles go in handles.
+void SceneStore::AddRows(const unsigned char *types, const int *counts,
+                         const PackedColor *colors,
+                         const unsigned char *flags, int numShapes,
+                         const double *xs, const double *ys,
+                         ShapeHandle *handles) {
+  int firstRow = mTypes.size();
+  int firstVertex = mXs.size(), offset = firstVertex;
+  mOffsets.resize(firstRow + numShapes);
+  for (int i = 0; i < numShapes; ++i) {
+    mOffsets[firstRow + i] = offset;
+    offset += counts[i];
+  }
+  mXs.insert(mXs.end(), xs, xs + (offset - firstVertex));
+  mYs.insert(mYs.end(), ys, ys + (offset - firstVertex));
+  mCounts.insert(mCounts.end(), counts, counts + numShapes);
+  mTypes.insert(mTypes.end(), types, types + numShapes);
+  mColors.insert(mColors.end(), colors, colors + numShapes);
+  mFlags.insert(mFlags.end(), flags, flags + numShapes);
+
+  mRowSlots.resize(firstRow + numShapes);
+  for (int i = 0; i < numShapes; ++i) {
+    ShapeHandle &handle = handles[i];
+    if (mFreeSlots.empty()) {
+      handle.slot = mSlotRows.size();
+      mSlotRows.push_back(-1);
+      mSlotGenerations.push_back(0);
+    } else {
+      handle.slot = mFreeSlots.back();
+      mFreeSlots.pop_back();
+    }
+    handle.generation = mNextGeneration++;
+    mSlotRows[handle.slot] = firstRow + i;
+    mSlotGenerations[handle.slot] = handle.generation;
+    mRowSlots[firstRow + i] = handle.slot;
+  }
+}
+
+// Appends a vertex to a shape's run, which only works while that run is still
+// at the end of the coordinate arrays (i.e., right after Add).
+void SceneStore::AddVertex(ShapeHandle handle, double x, double y) {
+  int row = GetRow(handle);
+  if (mOffsets[row] + mCounts[row] != (int) mXs.size()) {
+    cerr << "Error: vertex added to a shape that is not the newest." << endl;
+    return;
+  }
+  mXs.push_back(x);
+  mYs.push_back(y);
+  ++mCounts[row];
+}
+
+void SceneStore::Remove(ShapeHandle handle) {
+  if (!IsValid(handle)) {
+    return;
+  }
+  int row = GetRow(handle);
+  if (mOffsets[row] + mCounts[row] == (int) mXs.size()) {
+    mXs.resize(mOffsets[row]);
+    mYs.resize(mOffsets[row]);
+  } else {
+    mGarbage += mCounts[row];
+  }
+  mOffsets.erase(mOffsets.begin() + row);
+  mCounts.erase(mCounts.begin() + row);
+  mTypes.erase(mTypes.begin() + row);
+  mColors.erase(mColors.begin() + row);
+  mFlags.erase(mFlags.begin() + row);
+  mRowSlots.erase(mRowSlots.begin() + row);
+  for (int i = row; i < (int) mRowSlots.size(); ++i) {
+    mSlotRows[mRowSlots[i]] = i;
+  }
+  mSlotRows[handle.slot] = -1;
+  mFreeSlots.push_back(handle.slot);
+  if (mGarbage > NumVertices()) {
+    Compact();
+  }
+}
+
+// Drops every shape. Handles issued before the call all become invalid.
+void SceneStore::Clear() {
+  mXs.clear();
+  mYs.clear();
+  mOffsets.clear();
+  mCounts.clear();
+  mTypes.clear();
+  mColors.clear();
+  mFlags.clear();
+  mRowSlots.clear();
+  mSlotRows.clear();
+  mSlotGenerations.clear();
+  mFreeSlots.clear();
+  mGarbage = 0;
+}
+
+// Makes room for a known number of shapes and vertices, as loading does, so
+// the columns grow once rather than repeatedly.
+void SceneStore::Reserve(int numShapes, int numVertices) {
+  mXs.reserve(numVertices + mGarbage);
+  mYs.reserve(numVertices + mGarbage);
+  mOffsets.reserve(numShapes);
+  mCounts.reserve(numShapes);
+  mTypes.reserve(numShapes);
+  mColors.reserve(numShapes);
+  mFlags.reserve(numShapes);
+  mRowSlots.reserve(numShapes);
+  mSlotRows.reserve(numShapes);
+  mSlotGenerations.reserve(numShapes);
+}
+
+bool SceneStore::IsValid(ShapeHandle handle) const {
+  return handle.slot >= 0 && handle.slot < (int) mSlotRows.size() &&
+         mSlotRows[handle.slot] >= 0 &&
+         mSlotGenerations[handle.slot] == handle.generation;
+}
+
+void SceneStore::SetFlag(int row, unsigned char flag, bool on) {
+  if (on) {
+    mFlags[row] |= flag;
+  } else {
+    mFlags[row] &= ~flag;
+  }
+}
+
+// Slides every live run down over the garbage. Runs are in row order, so
+// each moves toward the front and none overlaps one not yet moved.
+void SceneStore::Compact() {
+  int next = 0;
+  for (int row = 0; row < (int) mOffsets.size(); ++row) {
+    int offset = mOffsets[row];
+    if (offset != next) {
+      for (int i = 0; i < mCounts[row]; ++i) {
+        mXs[next + i] = mXs[offset + i];
+        mYs[next + i] = mYs[offset + i];
+      }
+      mOffsets[row] = next;
+    }
+    next += mCounts[row];
+  }
+  mXs.resize(next);
+  mYs.resize(next);
+  mGarbage = 0;
+}
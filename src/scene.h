@@ -0,0 +1,92 @@
+/*******************************************************************************
+   Filename: scene.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for SceneStore, which keeps the vertices, colors and
+             flags of a set of shapes in parallel arrays (one row per shape,
+             one x and one y per vertex) so that passes over a whole scene
+             walk contiguous memory. Shape objects are thin views onto a row.
+*******************************************************************************/
+
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include "draw.h"
+
+// bits of the flags column
+const unsigned char SHAPE_FILLED = 0x01;
+const unsigned char SHAPE_SELECTED = 0x02;
+const unsigned char SHAPE_DIRTY = 0x04;  // changed since last tessellation
+
+// Eight bits per channel, laid out in memory as R, G, B, A like Vertex.
+typedef unsigned int PackedColor;
+
+PackedColor PackColor(double r, double g, double b);
+double UnpackRed(PackedColor color);
+double UnpackGreen(PackedColor color);
+double UnpackBlue(PackedColor color);
+
+// Names a shape for as long as it stays in its store, however the rows around
+// it move. Generations are never reused, so a handle to a removed shape stays
+// invalid even after its slot is recycled.
+struct ShapeHandle {
+  int slot;
+  unsigned int generation;
+};
+
+class SceneStore {
+ public:
+  SceneStore();
+  ShapeHandle Add(ShapeType type, const double *xs, const double *ys, int n,
+                  PackedColor color, unsigned char flags);
+  void AddRows(const unsigned char *types, const int *counts,
+               const PackedColor *colors, const unsigned char *flags,
+               int numShapes, const double *xs, const double *ys,
+               ShapeHandle *handles);
+  void AddVertex(ShapeHandle handle, double x, double y);
+  void Remove(ShapeHandle handle);
+  void Clear();
+  void Reserve(int numShapes, int numVertices);
+  bool IsValid(ShapeHandle handle) const;
+  int GetRow(ShapeHandle handle) const { return mSlotRows[handle.slot]; }
+  int NumShapes() const { return mTypes.size(); }
+  int NumVertices() const { return (int) mXs.size() - mGarbage; }
+
+  // per-vertex columns, indexed by GetOffset(row) + i
+  double *GetXs() { return mXs.empty() ? NULL : &mXs[0]; }
+  double *GetYs() { return mYs.empty() ? NULL : &mYs[0]; }
+  const double *GetXs() const { return mXs.empty() ? NULL : &mXs[0]; }
+  const double *GetYs() const { return mYs.empty() ? NULL : &mYs[0]; }
+
+  // per-shape columns, indexed by row (drawing order)
+  int GetOffset(int row) const { return mOffsets[row]; }
+  int GetCount(int row) const { return mCounts[row]; }
+  ShapeType GetType(int row) const { return (ShapeType) mTypes[row]; }
+  void SetType(int row, ShapeType type) { mTypes[row] = type; }
+  PackedColor GetColor(int row) const { return mColors[row]; }
+  void SetColor(int row, PackedColor color) { mColors[row] = color; }
+  bool HasFlag(int row, unsigned char flag) const {
+    return (mFlags[row] & flag) != 0;
+  }
+  void SetFlag(int row, unsigned char flag, bool on);
+ private:
+  void Compact();
+
+  vector<double> mXs, mYs;
+  vector<int> mOffsets, mCounts;
+  vector<unsigned char> mTypes;
+  vector<PackedColor> mColors;
+  vector<unsigned char> mFlags;
+  vector<int> mRowSlots;  // slot of each row
+  vector<int> mSlotRows;  // row of each slot, or -1 if the slot is free
+  vector<unsigned int> mSlotGenerations;
+  vector<int> mFreeSlots;
+  unsigned int mNextGeneration;
+  int mGarbage;  // vertices of removed shapes not yet compacted away
+};
+
+extern SceneStore gScene;       // shapes drawn on the canvas
+extern SceneStore gPanelScene;  // buttons, sliders and labels
+
+#endif  // SCENE_H_
@@ -9,6 +9,7 @@ Description: Method definitions for the following shape-related classes:
 *******************************************************************************/
 
 #include "shapes.h"
+#include "bezier.h"
 
 //
 // Point2D methods:
@@ -25,212 +26,255 @@ void Point2D::Draw() {
 }
 
 bool Point2D::Contains(double x, double y) const {
-  double distance = sqrt((x - mX) * (x - mX) + (y - mY) * (y - mY));
+  double dx = x - mX;
+  double dy = y - mY;
 
-  return distance < POINT_RADIUS;
+  return dx * dx + dy * dy < POINT_RADIUS * POINT_RADIUS;
 }
 
 //
 // Shape methods:
 //
 
-Shape::Shape(vector<Point2D *> points,
+// Copies the given points into the store; the caller still owns them.
+Shape::Shape(const vector<Point2D *> &points,
              const double r, const double g, const double b,
-             bool filled) {
-  vector<Point2D *>::iterator iter;
-  for (iter = points.begin(); iter < points.end(); ++iter) {
-    mVertices.push_back(*iter);
+             bool filled, SceneStore *store) {
+  int n = points.size();
+  vector<double> xs(n + 1), ys(n + 1);  // never empty, so &xs[0] is valid
+  for (int i = 0; i < n; ++i) {
+    xs[i] = points[i]->GetX();
+    ys[i] = points[i]->GetY();
   }
-  SetColor(r, g, b);
-  mShapeType = NONE;
-  mFilled = filled;
-  mSelected = true;  // shapes are "selected" by default when created
+
+  // shapes are "selected" by default when created
+  mStore = store;
+  mHandle = mStore->Add(NONE, &xs[0], &ys[0], n, PackColor(r, g, b),
+                        (filled ? SHAPE_FILLED : 0) | SHAPE_SELECTED |
+                          SHAPE_DIRTY);
+}
+
+Shape::Shape(ShapeHandle handle, SceneStore *store) {
+  mStore = store;
+  mHandle = handle;
 }
 
 Shape::~Shape() {
-  mVertices.clear();
+  mStore->Remove(mHandle);
 }
 
-void Shape::DrawPoints() {
-  if (!mSelected) {
+// Appends the positions of this shape's control-point handles, which are only
+// shown while the shape is selected.
+void Shape::AppendPoints(vector<GLfloat> *out) const {
+  if (!IsSelected()) {
     return;
   }
-  vector<Point2D *>::iterator iter;
-  for (iter = mVertices.begin(); iter < mVertices.end(); ++iter) {
-    (*iter)->Draw();
+  int n = NumPoints();
+  const double *xs = GetXs(), *ys = GetYs();
+  for (int i = 0; i < n; ++i) {
+    out->push_back((GLfloat) xs[i]);
+    out->push_back((GLfloat) ys[i]);
   }
 }
 
-void Shape::Adjust(double x, double y, Point2D *selectedPoint) {
-  selectedPoint->SetX(x);
-  selectedPoint->SetY(y);
+// Finds the box around the shape's vertices, which also holds a Bezier curve
+// (it never leaves the hull of its control points).
+void Shape::GetBounds(double *left, double *bottom,
+                      double *right, double *top) const {
+  int n = NumPoints();
+  const double *xs = GetXs(), *ys = GetYs();
+  *left = *right = xs[0];
+  *bottom = *top = ys[0];
+  for (int i = 1; i < n; ++i) {
+    *left = min(*left, xs[i]);
+    *right = max(*right, xs[i]);
+    *bottom = min(*bottom, ys[i]);
+    *top = max(*top, ys[i]);
+  }
 }
 
-void Shape::Move(double x, double y, Point2D *selectedPoint) {
-  double dx, dy;
-  vector<Point2D *>::iterator iter;
-  for (iter = mVertices.begin(); iter < mVertices.end(); ++iter) {
-    if (*iter == selectedPoint) {
-      continue;
-    }
-    dx = (*iter)->GetX() - selectedPoint->GetX();
-    dy = (*iter)->GetY() - selectedPoint->GetY();
-    (*iter)->SetX(x + dx);
-    (*iter)->SetY(y + dy);
+void Shape::Adjust(double x, double y, int vertex) {
+  GetXs()[vertex] = x;
+  GetYs()[vertex] = y;
+  SetDirty(true);
+}
+
+// Translates every vertex so that the given one ends up at (x, y).
+void Shape::Move(double x, double y, int vertex) {
+  int n = NumPoints();
+  double *xs = GetXs(), *ys = GetYs();
+  double dx = x - xs[vertex];
+  double dy = y - ys[vertex];
+  for (int i = 0; i < n; ++i) {
+    xs[i] += dx;
+    ys[i] += dy;
   }
-  selectedPoint->SetX(x);
-  selectedPoint->SetY(y);
+  xs[vertex] = x;
+  ys[vertex] = y;
+  SetDirty(true);
+}
+
+GLenum Shape::GetPrimitiveMode() const {
+  return IsFilled() ? GL_TRIANGLES : GL_LINES;
 }
 
 void Shape::SetColor(double r, double g, double b) {
-  mRed = r;
-  mGreen = g;
-  mBlue = b;
+  mStore->SetColor(GetRow(), PackColor(r, g, b));
+  SetDirty(true);
+}
+
+const double Shape::SetRed(double r) {
+  SetColor(r, GetGreen(), GetBlue());
+  return GetRed();
+}
+
+const double Shape::SetGreen(double g) {
+  SetColor(GetRed(), g, GetBlue());
+  return GetGreen();
+}
+
+const double Shape::SetBlue(double b) {
+  SetColor(GetRed(), GetGreen(), b);
+  return GetBlue();
 }
 
 //
 // Line methods:
 //
 
-Line::Line(vector<Point2D *> points,
+Line::Line(const vector<Point2D *> &points,
            const double r, const double g, const double b)
     : Shape(points, r, g, b, false) {
-  if (mVertices.size() != 2) {
-    cerr << "Error: " << mVertices.size()
+  if (NumPoints() != 2) {
+    cerr << "Error: " << NumPoints()
          << " vertices passed to Line constructor." << endl;
   }
-  mShapeType = LINE;
+  SetShapeType(LINE);
 }
 
-void Line::Draw() {
-  glColor3d(mRed, mGreen, mBlue);
-  glBegin(GL_LINES);
-  glVertex2d(mVertices[0]->GetX(), mVertices[0]->GetY());
-  glVertex2d(mVertices[1]->GetX(), mVertices[1]->GetY());
-  glEnd();
-  DrawPoints();
+void Line::Tessellate(vector<Vertex> *out) const {
+  AppendVertex(out, GetX(0), GetY(0), GetRed(), GetGreen(), GetBlue());
+  AppendVertex(out, GetX(1), GetY(1), GetRed(), GetGreen(), GetBlue());
 }
 
 //
 // BezierCurve methods:
 //
 
-BezierCurve::BezierCurve(vector<Point2D *> points,
+BezierCurve::BezierCurve(const vector<Point2D *> &points,
                          const double r, const double g, const double b)
     : Shape(points, r, g, b, false) {
-  if (mVertices.size() != 4) {
-    cerr << "Error: " << mVertices.size()
+  if (NumPoints() != 4) {
+    cerr << "Error: " << NumPoints()
          << " vertices passed to BezierCurve constructor." << endl;
   }
-  mShapeType = BEZIER_CURVE;
+  SetShapeType(BEZIER_CURVE);
 }
 
 Point2D *BezierCurve::Evaluate(double t) const {
-  double x = mVertices[0]->GetX() * (1 - t) * (1 - t) * (1 - t) +
-               3 * mVertices[1]->GetX() * (1 - t) * (1 - t) * t +
-               3 * mVertices[2]->GetX() * (1 - t) * t * t +
-               mVertices[3]->GetX() * t * t * t;
-  double y = mVertices[0]->GetY() * (1 - t) * (1 - t) * (1 - t) +
-               3 * mVertices[1]->GetY() * (1 - t) * (1 - t) * t +
-               3 * mVertices[2]->GetY() * (1 - t) * t * t +
-               mVertices[3]->GetY() * t * t * t;
+  double x, y;
+  Evaluate(t, &x, &y);
 
   return new Point2D(x, y);
 }
 
-void BezierCurve::Draw() {
-  Point2D *p1, *p2;
-  for (int i = 0; i < CURVE_RESOLUTION; ++i) {
-    p1 = Evaluate((double) i / CURVE_RESOLUTION);
-    p2 = Evaluate((double) (i + 1) / CURVE_RESOLUTION);
-    glColor3d(mRed, mGreen, mBlue);
-    glBegin(GL_LINES);
-    glVertex2d(p1->GetX(), p1->GetY());
-    glVertex2d(p2->GetX(), p2->GetY());
-    glEnd();
-    delete p1, p2;
+void BezierCurve::Evaluate(double t, double *x, double *y) const {
+  Evaluate(&t, 1, x, y);
+}
+
+// Evaluates the curve at n parameter values into the caller's buffers.
+void BezierCurve::Evaluate(const double *ts, int n,
+                           double *xs, double *ys) const {
+  double controlX[4], controlY[4];
+  GetControlPoints(controlX, controlY);
+  EvaluateCubicBezier(controlX, controlY, ts, n, xs, ys);
+}
+
+void BezierCurve::GetControlPoints(double *xs, double *ys) const {
+  for (int i = 0; i < 4; ++i) {
+    xs[i] = GetX(i);
+    ys[i] = GetY(i);
+  }
+}
+
+// Flattens the curve into a polyline with just enough evenly spaced segments
+// to stay within the curve tolerance. MeshCache keeps the result until the
+// curve is edited, so nothing is cached here.
+void BezierCurve::Tessellate(vector<Vertex> *out) const {
+  double controlX[4], controlY[4];
+  GetControlPoints(controlX, controlY);
+  int segments = CubicBezierSegments(controlX, controlY, GetCurveTolerance());
+  double xs[MAX_CURVE_SEGMENTS + 1], ys[MAX_CURVE_SEGMENTS + 1];
+  EvaluateCubicBezierUniform(controlX, controlY, segments, xs, ys);
+  double r = GetRed(), g = GetGreen(), b = GetBlue();
+  for (int i = 0; i < segments; ++i) {
+    AppendVertex(out, xs[i], ys[i], r, g, b);
+    AppendVertex(out, xs[i + 1], ys[i + 1], r, g, b);
   }
-  DrawPoints();
 }
 
 //
 // Rectangle methods:
 //
 
-Rectangle::Rectangle(vector<Point2D *> points,
+Rectangle::Rectangle(const vector<Point2D *> &points,
                      const double r, const double g, const double b,
-                     bool filled)
-    : Shape(points, r, g, b, filled) {
-  if (mVertices.size() != 2 && mVertices.size() != 4)
-    cerr << "Error: " << mVertices.size()
+                     bool filled, SceneStore *store)
+    : Shape(points, r, g, b, filled, store) {
+  if (NumPoints() != 2 && NumPoints() != 4)
+    cerr << "Error: " << NumPoints()
          << " vertices passed to Rectangle constructor." << endl;
 
   // add the other two corner points for more convenient moving/resizing
-  if (mVertices.size() == 2) {
-    mVertices.push_back(new Point2D(mVertices[0]->GetX(),
-                                    mVertices[1]->GetY()));
-    mVertices.push_back(new Point2D(mVertices[1]->GetX(),
-                                    mVertices[0]->GetY()));
+  if (NumPoints() == 2) {
+    mStore->AddVertex(mHandle, GetX(0), GetY(1));
+    mStore->AddVertex(mHandle, GetX(1), GetY(0));
   }
+  UpdateBounds();
+  SetShapeType(RECTANGLE);
+}
 
-  mLeft = mVertices[0]->GetX() < mVertices[1]->GetX() ?
-            mVertices[0]->GetX() : mVertices[1]->GetX();
-  mRight = mVertices[0]->GetX() > mVertices[1]->GetX() ?
-             mVertices[0]->GetX() : mVertices[1]->GetX();
-  mTop = mVertices[0]->GetY() > mVertices[1]->GetY() ?
-           mVertices[0]->GetY() : mVertices[1]->GetY();
-  mBottom = mVertices[0]->GetY() < mVertices[1]->GetY() ?
-              mVertices[0]->GetY() : mVertices[1]->GetY();
+// The row must already hold all four corners.
+Rectangle::Rectangle(ShapeHandle handle) : Shape(handle) {
+  UpdateBounds();
+}
 
-  mShapeType = RECTANGLE;
+void Rectangle::Tessellate(vector<Vertex> *out) const {
+  double xs[4] = {mLeft, mRight, mRight, mLeft};
+  double ys[4] = {mTop, mTop, mBottom, mBottom};
+  AppendPolygon(out, xs, ys, 4, IsFilled(), GetRed(), GetGreen(), GetBlue());
 }
 
-void Rectangle::Draw() {
-  if (mFilled) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  } else {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  }
-  glColor3d(mRed, mGreen, mBlue);
-  DrawRectangle(mLeft, mTop, mRight, mBottom);
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  DrawPoints();
-}
-
-void Rectangle::Move(double x, double y, Point2D *selectedPoint) {
-  Shape::Move(x, y, selectedPoint);
-  mLeft = mVertices[0]->GetX() < mVertices[1]->GetX() ?
-            mVertices[0]->GetX() : mVertices[1]->GetX();
-  mRight = mVertices[0]->GetX() > mVertices[1]->GetX() ?
-             mVertices[0]->GetX() : mVertices[1]->GetX();
-  mTop = mVertices[0]->GetY() > mVertices[1]->GetY() ?
-           mVertices[0]->GetY() : mVertices[1]->GetY();
-  mBottom = mVertices[0]->GetY() < mVertices[1]->GetY() ?
-              mVertices[0]->GetY() : mVertices[1]->GetY();
-}
-
-void Rectangle::Adjust(double x, double y, Point2D *selectedPoint) {
-  vector<Point2D *>::iterator iter;
-  for (iter = mVertices.begin(); iter < mVertices.end(); ++iter) {
-    if ((*iter) != selectedPoint) {
-      if ((*iter)->GetX() == selectedPoint->GetX()) {
-        (*iter)->SetX(x);
+void Rectangle::Move(double x, double y, int vertex) {
+  Shape::Move(x, y, vertex);
+  UpdateBounds();
+}
+
+// Drags the selected corner, taking the corners that share its x or y along.
+void Rectangle::Adjust(double x, double y, int vertex) {
+  int n = NumPoints();
+  double *xs = GetXs(), *ys = GetYs();
+  for (int i = 0; i < n; ++i) {
+    if (i != vertex) {
+      if (xs[i] == xs[vertex]) {
+        xs[i] = x;
       }
-      if ((*iter)->GetY() == selectedPoint->GetY()) {
-        (*iter)->SetY(y);
+      if (ys[i] == ys[vertex]) {
+        ys[i] = y;
       }
     }
   }
-  selectedPoint->SetX(x);
-  selectedPoint->SetY(y);
-  mLeft = mVertices[0]->GetX() < mVertices[1]->GetX() ?
-            mVertices[0]->GetX() : mVertices[1]->GetX();
-  mRight = mVertices[0]->GetX() > mVertices[1]->GetX() ?
-             mVertices[0]->GetX() : mVertices[1]->GetX();
-  mTop = mVertices[0]->GetY() > mVertices[1]->GetY() ?
-           mVertices[0]->GetY() : mVertices[1]->GetY();
-  mBottom = mVertices[0]->GetY() < mVertices[1]->GetY() ?
-              mVertices[0]->GetY() : mVertices[1]->GetY();
+  xs[vertex] = x;
+  ys[vertex] = y;
+  SetDirty(true);
+  UpdateBounds();
+}
+
+void Rectangle::UpdateBounds() {
+  mLeft = GetX(0) < GetX(1) ? GetX(0) : GetX(1);
+  mRight = GetX(0) > GetX(1) ? GetX(0) : GetX(1);
+  mTop = GetY(0) > GetY(1) ? GetY(0) : GetY(1);
+  mBottom = GetY(0) < GetY(1) ? GetY(0) : GetY(1);
 }
 
 bool Rectangle::Contains(double x, double y) const {
@@ -241,146 +285,132 @@ bool Rectangle::Contains(double x, double y) const {
 // Triangle methods:
 //
 
-Triangle::Triangle(vector<Point2D *> points,
+Triangle::Triangle(const vector<Point2D *> &points,
                    const double r, const double g, const double b,
                    bool filled)
     : Shape(points, r, g, b, filled) {
-  if (mVertices.size() != 3) {
-    cerr << "Error: " << mVertices.size()
+  if (NumPoints() != 3) {
+    cerr << "Error: " << NumPoints()
          << " vertices passed to Triangle constructor." << endl;
   }
-  mShapeType = TRIANGLE;
+  SetShapeType(TRIANGLE);
 }
 
-void Triangle::Draw() {
-  if (mFilled) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  } else {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+void Triangle::Tessellate(vector<Vertex> *out) const {
+  double xs[3], ys[3];
+  for (int i = 0; i < 3; ++i) {
+    xs[i] = GetX(i);
+    ys[i] = GetY(i);
   }
-  glColor3d(mRed, mGreen, mBlue);
-  DrawTriangle(mVertices[0]->GetX(), mVertices[0]->GetY(),
-               mVertices[1]->GetX(), mVertices[1]->GetY(),
-               mVertices[2]->GetX(), mVertices[2]->GetY());
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  DrawPoints();
+  AppendPolygon(out, xs, ys, 3, IsFilled(), GetRed(), GetGreen(), GetBlue());
 }
 
 //
 // Pentagon methods:
 //
 
-Pentagon::Pentagon(vector<Point2D *> points,
+Pentagon::Pentagon(const vector<Point2D *> &points,
                    const double r, const double g, const double b,
                    bool filled)
     : Shape(points, r, g, b, filled) {
-  if (mVertices.size() != 5) {
-    cerr << "Error: " << mVertices.size()
+  if (NumPoints() != 5) {
+    cerr << "Error: " << NumPoints()
          << " vertices passed to Pentagon constructor." << endl;
   }
-  mShapeType = PENTAGON;
+  SetShapeType(PENTAGON);
 }
 
-void Pentagon::Draw() {
-  if (mFilled) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  } else {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+void Pentagon::Tessellate(vector<Vertex> *out) const {
+  double xs[5], ys[5];
+  for (int i = 0; i < 5; ++i) {
+    xs[i] = GetX(i);
+    ys[i] = GetY(i);
   }
-  glColor3d(mRed, mGreen, mBlue);
-  glBegin(GL_POLYGON);
-  glVertex2d(mVertices[0]->GetX(), mVertices[0]->GetY());
-  glVertex2d(mVertices[1]->GetX(), mVertices[1]->GetY());
-  glVertex2d(mVertices[2]->GetX(), mVertices[2]->GetY());
-  glVertex2d(mVertices[3]->GetX(), mVertices[3]->GetY());
-  glVertex2d(mVertices[4]->GetX(), mVertices[4]->GetY());
-  glEnd();
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  DrawPoints();
+  AppendPolygon(out, xs, ys, 5, IsFilled(), GetRed(), GetGreen(), GetBlue());
 }
 
 //
 // Circle methods:
 //
 
-Circle::Circle(vector<Point2D *> points,
+Circle::Circle(const vector<Point2D *> &points,
                double r, double g, double b,
                bool filled)
     : Shape(points, r, g, b, filled) {
-  if (mVertices.size() != 2) {
-    cerr << "Error: " << mVertices.size()
+  if (NumPoints() != 2) {
+    cerr << "Error: " << NumPoints()
          << " vertices passed to Circle constructor." << endl;
   } else {
     // use 2nd vertex to determine radius
-    mRadius = sqrt((mVertices[0]->GetX() - mVertices[1]->GetX()) *
-                   (mVertices[0]->GetX() - mVertices[1]->GetX()) +
-                   (mVertices[0]->GetY() - mVertices[1]->GetY()) *
-                   (mVertices[0]->GetY() - mVertices[1]->GetY()));
+    mRadius = sqrt((GetX(0) - GetX(1)) * (GetX(0) - GetX(1)) +
+                   (GetY(0) - GetY(1)) * (GetY(0) - GetY(1)));
   }
-  mShapeType = CIRCLE;
+  SetShapeType(CIRCLE);
 }
 
-void Circle::Draw() {
-  if (mFilled) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  } else {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+Circle::Circle(ShapeHandle handle) : Shape(handle) {
+  mRadius = sqrt((GetX(0) - GetX(1)) * (GetX(0) - GetX(1)) +
+                 (GetY(0) - GetY(1)) * (GetY(0) - GetY(1)));
+}
+
+void Circle::Tessellate(vector<Vertex> *out) const {
+  const double *cosines, *sines;
+  int n = GetUnitCircle(mRadius, &cosines, &sines);
+  vector<double> xs(n), ys(n);
+  for (int i = 0; i < n; ++i) {
+    xs[i] = GetX(0) + mRadius * cosines[i];
+    ys[i] = GetY(0) + mRadius * sines[i];
   }
-  glColor3d(mRed, mGreen, mBlue);
-  DrawCircle(mVertices[0]->GetX(), mVertices[0]->GetY(), mRadius);
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  DrawPoints();
+  AppendPolygon(out, &xs[0], &ys[0], n, IsFilled(),
+                GetRed(), GetGreen(), GetBlue());
 }
 
-void Circle::Adjust(double x, double y, Point2D *selectedPoint) {
-  Shape::Adjust(x, y, selectedPoint);
-  mRadius = sqrt((mVertices[0]->GetX() - mVertices[1]->GetX()) *
-                 (mVertices[0]->GetX() - mVertices[1]->GetX()) +
-                 (mVertices[0]->GetY() - mVertices[1]->GetY()) *
-                 (mVertices[0]->GetY() - mVertices[1]->GetY()));
+void Circle::GetBounds(double *left, double *bottom,
+                       double *right, double *top) const {
+  *left = GetX(0) - mRadius;
+  *right = GetX(0) + mRadius;
+  *bottom = GetY(0) - mRadius;
+  *top = GetY(0) + mRadius;
+}
+
+void Circle::Adjust(double x, double y, int vertex) {
+  Shape::Adjust(x, y, vertex);
+  mRadius = sqrt((GetX(0) - GetX(1)) * (GetX(0) - GetX(1)) +
+                 (GetY(0) - GetY(1)) * (GetY(0) - GetY(1)));
 }
 
 //
 // Button methods:
 //
 
-Button::Button(vector<Point2D *> points,
+Button::Button(const vector<Point2D *> &points,
                const double r, const double g, const double b,
                const char * text, const int buttonType, const int associatedID)
-    : Rectangle(points, r, g, b, true) {
+    : Rectangle(points, r, g, b, true, &gPanelScene) {
   SetText(text);
   mButtonType = buttonType;
   mAssociatedID = associatedID;
   mPressed = false;
-  mSelected = false;
+  SetSelected(false);
 }
 
 void Button::Draw() {
   // draw black outline if button is selected
-  if (mSelected) {
+  if (IsSelected()) {
     glColor3d(0, 0, 0);
-    double x1 = mVertices[0]->GetX() < mVertices[1]->GetX() ?
-                  mVertices[0]->GetX() : mVertices[1]->GetX();
-    double x2 = mVertices[0]->GetX() > mVertices[1]->GetX() ?
-                  mVertices[0]->GetX() : mVertices[1]->GetX();
-    double y1 = mVertices[0]->GetY() > mVertices[1]->GetY() ?
-                  mVertices[0]->GetY() : mVertices[1]->GetY();
-    double y2 = mVertices[0]->GetY() < mVertices[1]->GetY() ?
-                  mVertices[0]->GetY() : mVertices[1]->GetY();
-    DrawRectangle(x1 - BUTTON_OUTLINE_THICKNESS,
-                  y1 + BUTTON_OUTLINE_THICKNESS,
-                  x2 + BUTTON_OUTLINE_THICKNESS,
-                  y2 - BUTTON_OUTLINE_THICKNESS);
+    DrawRectangle(mLeft - BUTTON_OUTLINE_THICKNESS,
+                  mTop + BUTTON_OUTLINE_THICKNESS,
+                  mRight + BUTTON_OUTLINE_THICKNESS,
+                  mBottom - BUTTON_OUTLINE_THICKNESS);
   }
 
   // draw button
   if (mPressed) {
-    glColor3d(mRed - 0.5, mGreen - 0.5, mBlue - 0.5);
+    glColor3d(GetRed() - 0.5, GetGreen() - 0.5, GetBlue() - 0.5);
   } else {
-    glColor3d(mRed, mGreen, mBlue);
+    glColor3d(GetRed(), GetGreen(), GetBlue());
   }
-  DrawRectangle(mVertices[0]->GetX(), mVertices[0]->GetY(),
-                mVertices[1]->GetX(), mVertices[1]->GetY());
+  DrawRectangle(GetX(0), GetY(0), GetX(1), GetY(1));
 
   // draw button text
   if (mPressed) {
@@ -388,18 +418,14 @@ void Button::Draw() {
   } else {
     glColor3d(0, 0, 0);
   }
-  DrawText((mVertices[0]->GetX() < mVertices[1]->GetX() ?
-              mVertices[0]->GetX() : mVertices[1]->GetX()) +
-             BUTTON_TEXT_OFFSET_X,
-           (mVertices[0]->GetY() > mVertices[1]->GetY() ?
-              mVertices[0]->GetY() : mVertices[1]->GetY()) -
-             BUTTON_TEXT_OFFSET_Y,
-           mText);
+  DrawText(mLeft + BUTTON_TEXT_OFFSET_X, mTop - BUTTON_TEXT_OFFSET_Y,
+           mText, &mTextLayout);
 }
 
 const char *Button::SetText(const char *text) {
   strncpy(mText, text, BUTTON_TEXT_MAX_LEN);
   mText[BUTTON_TEXT_MAX_LEN] = '\0';
+  mTextLayout.valid = false;
 
   return mText;
 }
@@ -408,7 +434,7 @@ const char *Button::SetText(const char *text) {
 // Slider methods:
 //
 
-Slider::Slider(vector<Point2D *> points,
+Slider::Slider(const vector<Point2D *> &points,
                const double r, const double g, const double b,
                const int associatedID)
     : Button(points, r, g, b, "", RGB_SLIDER, associatedID) {
@@ -418,37 +444,100 @@ Slider::Slider(vector<Point2D *> points,
 void Slider::Draw() {
   // draw background
   glColor3d(0, 0, 0);
-  DrawRectangle(mVertices[0]->GetX(), mVertices[0]->GetY(),
-                mVertices[1]->GetX(), mVertices[1]->GetY());
+  DrawRectangle(GetX(0), GetY(0), GetX(1), GetY(1));
 
   // draw slider
-  glColor3d(mRed, mGreen, mBlue);
-  DrawRectangle(mVertices[0]->GetX(), mVertices[0]->GetY(),
-                mSliderLength + mLeft, mVertices[1]->GetY());
+  glColor3d(GetRed(), GetGreen(), GetBlue());
+  DrawRectangle(GetX(0), GetY(0), mSliderLength + mLeft, GetY(1));
 }
 
 //
 // Label methods:
 //
 
-Label::Label(vector<Point2D *> points,
+Label::Label(const vector<Point2D *> &points,
              const double r, const double g, const double b,
              const char * text)
   : Button(points, r, g, b, text, LABEL, NONE) {}
 
 void Label::Draw() {
   // draw background
-  glColor3d(mRed, mGreen, mBlue);
-  DrawRectangle(mVertices[0]->GetX(), mVertices[0]->GetY(),
-                mVertices[1]->GetX(), mVertices[1]->GetY());
+  glColor3d(GetRed(), GetGreen(), GetBlue());
+  DrawRectangle(GetX(0), GetY(0), GetX(1), GetY(1));
 
   // draw label text
   glColor3d(0, 0, 0);
-  DrawText((mVertices[0]->GetX() < mVertices[1]->GetX() ?
-              mVertices[0]->GetX() : mVertices[1]->GetX()) +
-            BUTTON_TEXT_OFFSET_X,
-           (mVertices[0]->GetY() > mVertices[1]->GetY() ?
-              mVertices[0]->GetY() : mVertices[1]->GetY()) -
-            BUTTON_TEXT_OFFSET_Y,
-           mText);
+  DrawText(mLeft + BUTTON_TEXT_OFFSET_X, mTop - BUTTON_TEXT_OFFSET_Y,
+           mText, &mTextLayout);
+}
+
+//
+// Shape factory:
+//
+
+// Whether a shape of the given type can be built from n vertices. Rectangles
+// may be given two opposite corners or all four.
+bool IsValidVertexCount(ShapeType type, int n) {
+  switch (type) {
+    case LINE:
+    case CIRCLE:
+      return n == 2;
+    case BEZIER_CURVE:
+      return n == 4;
+    case RECTANGLE:
+      return n == 2 || n == 4;
+    case TRIANGLE:
+      return n == 3;
+    case PENTAGON:
+      return n == 5;
+    default:
+      return false;
+  }
+}
+
+// Builds a finished shape of the given type, as loading a drawing does.
+// Returns NULL for NONE, an unknown type or the wrong number of vertices for
+// the type, which the shapes would otherwise read past.
+Shape *CreateShape(ShapeType type, const vector<Point2D *> &points,
+                   double r, double g, double b, bool filled) {
+  if (!IsValidVertexCount(type, points.size())) {
+    return NULL;
+  }
+  switch (type) {
+    case LINE:
+      return new Line(points, r, g, b);
+    case BEZIER_CURVE:
+      return new BezierCurve(points, r, g, b);
+    case RECTANGLE:
+      return new Rectangle(points, r, g, b, filled);
+    case TRIANGLE:
+      return new Triangle(points, r, g, b, filled);
+    case PENTAGON:
+      return new Pentagon(points, r, g, b, filled);
+    case CIRCLE:
+      return new Circle(points, r, g, b, filled);
+    default:
+      return NULL;
+  }
+}
+
+// Builds the view of a shape already in gScene, going by its type column.
+// The row must have a valid vertex count for its type.
+Shape *CreateShape(ShapeHandle handle) {
+  switch (gScene.GetType(gScene.GetRow(handle))) {
+    case LINE:
+      return new Line(handle);
+    case BEZIER_CURVE:
+      return new BezierCurve(handle);
+    case RECTANGLE:
+      return new Rectangle(handle);
+    case TRIANGLE:
+      return new Triangle(handle);
+    case PENTAGON:
+      return new Pentagon(handle);
+    case CIRCLE:
+      return new Circle(handle);
+    default:
+      return NULL;
+  }
 }
@@ -12,6 +12,8 @@ Description: Header file for the following shape-related classes: Point2D,
 #define SHAPES_H_
 
 #include "draw.h"
+#include "scene.h"
+#include "arena.h"
 
 enum ButtonType {
   MODE_BUTTON,
@@ -30,6 +32,7 @@ enum ButtonType {
 };
 
 const double POINT_RADIUS = 4.0;
+const double SHAPE_BOUNDS_MARGIN = 1.0;  // pixels drawn past a shape's bounds
 const double DEFAULT_POINT_RED = 0.0;
 const double DEFAULT_POINT_GREEN = 0.0;
 const double DEFAULT_POINT_BLUE = 0.0;
@@ -48,63 +51,117 @@ class Point2D {
   const double GetX() const { return mX; }
   const double GetY() const { return mY; }
   bool Contains(double x, double y) const;
+  static void *operator new(size_t size) {
+    return gDocumentArena.Allocate(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    gDocumentArena.Free(p, size);
+  }
  private:
   double mX, mY;
 };
 
 class Shape {
  public:
-  Shape(vector<Point2D *> points,
+  Shape(const vector<Point2D *> &points,
         const double r, const double g, const double b,
-        bool filled);
+        bool filled, SceneStore *store = &gScene);
+  // a view onto a row already in the store, such as one added by AddRows
+  Shape(ShapeHandle handle, SceneStore *store = &gScene);
   virtual ~Shape();
-  virtual void Draw() = 0;
-  virtual void DrawPoints();
-  virtual void Adjust(double x, double y, Point2D *selectedPoint);
-  virtual void Move(double x, double y, Point2D *selectedPoint);
+  void AppendPoints(vector<GLfloat> *out) const;
+  virtual void GetBounds(double *left, double *bottom,
+                         double *right, double *top) const;
+  virtual void Adjust(double x, double y, int vertex);
+  // Whether Adjust's result depends only on its arguments and not on where
+  // the vertices were before, so that of a run of adjustments to the same
+  // vertex only the last matters.
+  virtual bool IsAdjustAbsolute() const { return true; }
+  virtual void Move(double x, double y, int vertex);
+  // Appends the shape's vertices. Safe to call on several shapes at once
+  // from different threads, as MeshCache does.
+  virtual void Tessellate(vector<Vertex> *out) const = 0;
+  virtual GLenum GetPrimitiveMode() const;
   void SetColor(double r, double g, double b);
-  const double SetRed(double r) { return mRed = r; }
-  const double SetGreen(double g) { return mGreen = g; }
-  const double SetBlue(double b) { return mBlue = b; }
-  const double GetRed() const { return mRed; }
-  const double GetGreen() const { return mGreen; }
-  const double GetBlue() const { return mBlue; }
-  const bool IsFilled() const { return mFilled; }
-  const ShapeType GetShapeType() const { return mShapeType; }
-  Point2D *GetPointAt(int i) const { return mVertices[i]; }
-  int NumPoints() const { return mVertices.size(); }
-  bool SetSelected(const bool b) { return mSelected = b; }
-  bool IsSelected() const { return mSelected; }
+  const double SetRed(double r);
+  const double SetGreen(double g);
+  const double SetBlue(double b);
+  const double GetRed() const { return UnpackRed(GetColor()); }
+  const double GetGreen() const { return UnpackGreen(GetColor()); }
+  const double GetBlue() const { return UnpackBlue(GetColor()); }
+  PackedColor GetColor() const { return mStore->GetColor(GetRow()); }
+  const bool IsFilled() const { return HasFlag(SHAPE_FILLED); }
+  const ShapeType GetShapeType() const { return mStore->GetType(GetRow()); }
+  Point2D GetPointAt(int i) const { return Point2D(GetX(i), GetY(i)); }
+  double GetX(int i) const { return GetXs()[i]; }
+  double GetY(int i) const { return GetYs()[i]; }
+  int NumPoints() const { return mStore->GetCount(GetRow()); }
+  bool SetSelected(const bool b) { return SetFlag(SHAPE_SELECTED, b); }
+  bool IsSelected() const { return HasFlag(SHAPE_SELECTED); }
+  bool SetDirty(const bool b) { return SetFlag(SHAPE_DIRTY, b); }
+  bool IsDirty() const { return HasFlag(SHAPE_DIRTY); }
+  ShapeHandle GetHandle() const { return mHandle; }
+  static void *operator new(size_t size) {
+    return gDocumentArena.Allocate(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    gDocumentArena.Free(p, size);
+  }
  protected:
-  vector<Point2D *> mVertices;
-  double mRed, mGreen, mBlue;
-  ShapeType mShapeType;
-  bool mSelected, mFilled;
+  int GetRow() const { return mStore->GetRow(mHandle); }
+  // only valid until the next shape is added to or removed from the store
+  const double *GetXs() const {
+    return mStore->GetXs() + mStore->GetOffset(GetRow());
+  }
+  const double *GetYs() const {
+    return mStore->GetYs() + mStore->GetOffset(GetRow());
+  }
+  double *GetXs() { return mStore->GetXs() + mStore->GetOffset(GetRow()); }
+  double *GetYs() { return mStore->GetYs() + mStore->GetOffset(GetRow()); }
+  void SetShapeType(ShapeType type) { mStore->SetType(GetRow(), type); }
+  bool HasFlag(unsigned char flag) const {
+    return mStore->HasFlag(GetRow(), flag);
+  }
+  bool SetFlag(unsigned char flag, bool on) {
+    mStore->SetFlag(GetRow(), flag, on);
+    return on;
+  }
+  SceneStore *mStore;
+  ShapeHandle mHandle;
 };
 
 class Line : public Shape {
  public:
-  Line(vector<Point2D *> points,
+  Line(const vector<Point2D *> &points,
        const double r, const double g, const double b);
-  void Draw();
+  explicit Line(ShapeHandle handle) : Shape(handle) {}
+  void Tessellate(vector<Vertex> *out) const;
 };
 
 class BezierCurve : public Shape {
  public:
-  BezierCurve(vector<Point2D *> points,
+  BezierCurve(const vector<Point2D *> &points,
               const double r, const double g, const double b);
-  void Draw();
+  explicit BezierCurve(ShapeHandle handle) : Shape(handle) {}
+  void Tessellate(vector<Vertex> *out) const;
   Point2D *Evaluate(double t) const;
+  void Evaluate(double t, double *x, double *y) const;
+  void Evaluate(const double *ts, int n, double *xs, double *ys) const;
+  void GetControlPoints(double *xs, double *ys) const;
 };
 
 class Rectangle : public Shape {
  public:
-  Rectangle(vector<Point2D *> points,
+  Rectangle(const vector<Point2D *> &points,
             const double r, const double g, const double b,
-            bool filled);
-  void Draw();
-  void Adjust(double x, double y, Point2D *selectedPoint);
-  void Move(double x, double y, Point2D *selectedPoint);
+            bool filled, SceneStore *store = &gScene);
+  explicit Rectangle(ShapeHandle handle);
+  void Tessellate(vector<Vertex> *out) const;
+  void Adjust(double x, double y, int vertex);
+  // corners are taken along by where they are, so dragging one past
+  // another leaves it behind
+  bool IsAdjustAbsolute() const { return false; }
+  void Move(double x, double y, int vertex);
   bool Contains(double x, double y) const;
   double GetTop() const { return mTop; }
   double GetBottom() const { return mBottom; }
@@ -113,43 +170,49 @@ class Rectangle : public Shape {
   double GetLength() const { return mRight - mLeft; }
   double GetHeight() const { return mTop - mBottom; }
  protected:
+  void UpdateBounds();
   double mTop, mBottom, mLeft, mRight;
 };
 
 class Triangle : public Shape {
  public:
-  Triangle(vector<Point2D *> points,
+  Triangle(const vector<Point2D *> &points,
            const double r, const double g, const double b,
            bool filled);
-  void Draw();
+  explicit Triangle(ShapeHandle handle) : Shape(handle) {}
+  void Tessellate(vector<Vertex> *out) const;
 };
 
 class Pentagon : public Shape {
  public:
-  Pentagon(vector<Point2D *> points,
+  Pentagon(const vector<Point2D *> &points,
            const double r, const double g, const double b,
            bool filled);
-  void Draw();
+  explicit Pentagon(ShapeHandle handle) : Shape(handle) {}
+  void Tessellate(vector<Vertex> *out) const;
 };
 
 class Circle : public Shape {
  public:
-  Circle(vector<Point2D *> points,
+  Circle(const vector<Point2D *> &points,
          const double r, const double g, const double b,
          bool filled);
-  Point2D *GetCenter() const { return mVertices[0]; }
+  explicit Circle(ShapeHandle handle);
+  Point2D GetCenter() const { return GetPointAt(0); }
   double GetRadius() const { return mRadius; }
   double GetArea() const { return PI * mRadius * mRadius; }
   double GetCircumference() const { return 2 * PI * mRadius; }
-  void Draw();
-  void Adjust(double x, double y, Point2D *selectedPoint);
+  void Tessellate(vector<Vertex> *out) const;
+  void GetBounds(double *left, double *bottom,
+                 double *right, double *top) const;
+  void Adjust(double x, double y, int vertex);
 protected:
   double mRadius;
 };
 
 class Button : public Rectangle {
  public:
-  Button(vector<Point2D *> points,
+  Button(const vector<Point2D *> &points,
          const double r, const double g, const double b,
          const char *text, const int buttonType, const int associatedID);
   virtual void Draw();
@@ -158,8 +221,12 @@ class Button : public Rectangle {
   bool SetPressed(const bool b) { return mPressed = b; }
   bool IsPressed() const { return mPressed; }
   const char *SetText(const char *text);
+  // the control panel outlives any one drawing, so it stays on the heap
+  static void *operator new(size_t size) { return ::operator new(size); }
+  static void operator delete(void *p) { ::operator delete(p); }
 protected:
   char mText[BUTTON_TEXT_MAX_LEN + 1];
+  TextLayout mTextLayout;
   int mButtonType;
   int mAssociatedID;
   bool mPressed;
@@ -167,7 +234,7 @@ protected:
 
 class Slider : public Button {
  public:
-  Slider(vector<Point2D *> points,
+  Slider(const vector<Point2D *> &points,
          const double r, const double g, const double b,
          const int associatedID);
   virtual void Draw();
@@ -178,10 +245,15 @@ class Slider : public Button {
 
 class Label : public Button {
  public:
-  Label(vector<Point2D *> points,
+  Label(const vector<Point2D *> &points,
         const double r, const double g, const double b,
         const char *text);
   virtual void Draw();
 };
 
+bool IsValidVertexCount(ShapeType type, int n);
+Shape *CreateShape(ShapeType type, const vector<Point2D *> &points,
+                   double r, double g, double b, bool filled);
+Shape *CreateShape(ShapeHandle handle);
+
 #endif  // SHAPES_H_
@@ -0,0 +1,149 @@
+/*******************************************************************************
+   Filename: spatial.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for SpatialIndex. Cells are POINT_RADIUS * 2
+             pixels wide, so a click can only hit vertices in the (at most)
+             four cells its handle-sized neighborhood overlaps.
+*******************************************************************************/
+
+#include "spatial.h"
+
+SpatialIndex::SpatialIndex() {
+  mNextOrder = 0;
+}
+
+void SpatialIndex::Insert(Shape *shape) {
+  Record &record = mShapes[shape];
+  record.order = mNextOrder++;
+  AddEntries(shape, &record);
+}
+
+// Re-files a shape's vertices after Move or Adjust has changed them. Only
+// vertices that crossed into a different cell are touched.
+void SpatialIndex::Update(Shape *shape) {
+  unordered_map<Shape *, Record>::iterator found = mShapes.find(shape);
+  if (found == mShapes.end()) {
+    return;
+  }
+  Record &record = found->second;
+  for (int i = 0; i < shape->NumPoints(); ++i) {
+    CellKey key = KeyFor(shape->GetX(i), shape->GetY(i));
+    if (key == record.keys[i]) {
+      continue;
+    }
+    vector<Entry> &cell = mCells[record.keys[i]];
+    for (int j = 0; j < (int) cell.size(); ++j) {
+      if (cell[j].shape == shape && cell[j].vertex == i) {
+        cell[j] = cell.back();
+        cell.pop_back();
+        break;
+      }
+    }
+    if (cell.empty()) {
+      mCells.erase(record.keys[i]);
+    }
+    Entry entry;
+    entry.shape = shape;
+    entry.vertex = i;
+    entry.order = record.order;
+    mCells[key].push_back(entry);
+    record.keys[i] = key;
+  }
+}
+
+void SpatialIndex::Remove(Shape *shape) {
+  unordered_map<Shape *, Record>::iterator found = mShapes.find(shape);
+  if (found == mShapes.end()) {
+    return;
+  }
+  RemoveEntries(shape, found->second);
+  mShapes.erase(found);
+}
+
+void SpatialIndex::Clear() {
+  mCells.clear();
+  mShapes.clear();
+  mNextOrder = 0;
+}
+
+// Finds the vertex under (x, y), preferring the earliest-inserted shape and
+// then its lowest-numbered vertex, just as a front-to-back scan of gShapes
+// would.
+bool SpatialIndex::Pick(double x, double y,
+                        Shape **shape, int *vertex) const {
+  const Entry *best = NULL;
+  int loX = CellCoordinate(x - POINT_RADIUS);
+  int hiX = CellCoordinate(x + POINT_RADIUS);
+  int loY = CellCoordinate(y - POINT_RADIUS);
+  int hiY = CellCoordinate(y + POINT_RADIUS);
+  for (int cx = loX; cx <= hiX; ++cx) {
+    for (int cy = loY; cy <= hiY; ++cy) {
+      unordered_map<CellKey, vector<Entry> >::const_iterator cell =
+        mCells.find(MakeKey(cx, cy));
+      if (cell == mCells.end()) {
+        continue;
+      }
+      vector<Entry>::const_iterator iter;
+      for (iter = cell->second.begin(); iter < cell->second.end(); ++iter) {
+        if (best && (iter->order > best->order ||
+                     (iter->order == best->order &&
+                      iter->vertex > best->vertex))) {
+          continue;
+        }
+        if (iter->shape->GetPointAt(iter->vertex).Contains(x, y)) {
+          best = &*iter;
+        }
+      }
+    }
+  }
+  if (!best) {
+    return false;
+  }
+  *shape = best->shape;
+  *vertex = best->vertex;
+
+  return true;
+}
+
+int SpatialIndex::CellCoordinate(double v) {
+  return (int) floor(v / SPATIAL_CELL_SIZE);
+}
+
+SpatialIndex::CellKey SpatialIndex::MakeKey(int cx, int cy) {
+  return (CellKey) (((unsigned long long) (unsigned int) cx << 32) |
+                    (unsigned int) cy);
+}
+
+SpatialIndex::CellKey SpatialIndex::KeyFor(double x, double y) const {
+  return MakeKey(CellCoordinate(x), CellCoordinate(y));
+}
+
+void SpatialIndex::RemoveEntries(Shape *shape, const Record &record) {
+  for (int i = 0; i < (int) record.keys.size(); ++i) {
+    vector<Entry> &cell = mCells[record.keys[i]];
+    for (int j = 0; j < (int) cell.size(); ++j) {
+      if (cell[j].shape == shape) {
+        cell[j] = cell.back();
+        cell.pop_back();
+        --j;
+      }
+    }
+    if (cell.empty()) {
+      mCells.erase(record.keys[i]);
+    }
+  }
+}
+
+void SpatialIndex::AddEntries(Shape *shape, Record *record) {
+  record->keys.clear();
+  for (int i = 0; i < shape->NumPoints(); ++i) {
+    Entry entry;
+    entry.shape = shape;
+    entry.vertex = i;
+    entry.order = record->order;
+    record->keys.push_back(KeyFor(shape->GetX(i), shape->GetY(i)));
+    mCells[record->keys.back()].push_back(entry);
+  }
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+   Filename: spatial.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for SpatialIndex, a uniform grid over the vertices of
+             every shape on the canvas, used to find the clicked control point
+             without scanning the whole scene.
+*******************************************************************************/
+
+#ifndef SPATIAL_H_
+#define SPATIAL_H_
+
+#include <unordered_map>
+#include "shapes.h"
+
+const double SPATIAL_CELL_SIZE = 2 * POINT_RADIUS;
+
+class SpatialIndex {
+ public:
+  SpatialIndex();
+  void Insert(Shape *shape);
+  void Update(Shape *shape);
+  void Remove(Shape *shape);
+  void Clear();
+  bool Pick(double x, double y, Shape **shape, int *vertex) const;
+  int NumShapes() const { return mShapes.size(); }
+ private:
+  typedef long long CellKey;
+  struct Entry {
+    Shape *shape;
+    int vertex;
+    long order;  // insertion order, so earlier shapes win ties as in gShapes
+  };
+  struct Record {
+    long order;
+    vector<CellKey> keys;  // cell of each vertex when last indexed
+  };
+  static int CellCoordinate(double v);
+  static CellKey MakeKey(int cx, int cy);
+  CellKey KeyFor(double x, double y) const;
+  void RemoveEntries(Shape *shape, const Record &record);
+  void AddEntries(Shape *shape, Record *record);
+
+  unordered_map<CellKey, vector<Entry> > mCells;
+  unordered_map<Shape *, Record> mShapes;
+  long mNextOrder;
+};
+
+#endif  // SPATIAL_H_
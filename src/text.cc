@@ -0,0 +1,124 @@
+/*******************************************************************************
+   Filename: text.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for GlyphAtlas. The atlas is baked by drawing
+             each glyph with glutBitmapCharacter into the back buffer and
+             reading the result back, so it matches the bitmap font exactly.
+*******************************************************************************/
+
+#include "text.h"
+
+GlyphAtlas::GlyphAtlas() {
+  mTexture = 0;
+  mBuilt = false;
+  mFailed = false;
+  for (int i = 0; i < NUM_GLYPHS; ++i) {
+    mAdvance[i] = 0;
+  }
+}
+
+GlyphAtlas::~GlyphAtlas() {
+  if (mTexture) {
+    glDeleteTextures(1, &mTexture);
+  }
+}
+
+// Renders every printable glyph into a grid of cells in the lower-left corner
+// of the back buffer and copies it into an alpha texture. Must be called
+// before anything is drawn for the frame, since it overwrites that corner.
+bool GlyphAtlas::Build() {
+  void *font = GLUT_BITMAP_9_BY_15;
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (viewport[2] < GLYPH_ATLAS_WIDTH || viewport[3] < GLYPH_ATLAS_HEIGHT) {
+    mFailed = true;
+    return false;
+  }
+  ClearGLErrors();  // so only errors from the bake itself count
+
+  glColor3d(0, 0, 0);
+  DrawRectangle(0, 0, GLYPH_ATLAS_WIDTH, GLYPH_ATLAS_HEIGHT);
+  glColor3d(1, 1, 1);
+  for (int i = 0; i < NUM_GLYPHS; ++i) {
+    glRasterPos2i((i % GLYPH_ATLAS_COLUMNS) * GLYPH_CELL_SIZE,
+                  (i / GLYPH_ATLAS_COLUMNS) * GLYPH_CELL_SIZE + GLYPH_DESCENT);
+    glutBitmapCharacter(font, FIRST_GLYPH + i);
+    mAdvance[i] = glutBitmapWidth(font, FIRST_GLYPH + i);
+  }
+
+  vector<GLubyte> pixels(GLYPH_ATLAS_WIDTH * GLYPH_ATLAS_HEIGHT);
+  glReadBuffer(GL_BACK);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, GLYPH_ATLAS_WIDTH, GLYPH_ATLAS_HEIGHT, GL_RED,
+               GL_UNSIGNED_BYTE, &pixels[0]);
+
+  if (!mTexture) {
+    glGenTextures(1, &mTexture);
+  }
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, GLYPH_ATLAS_WIDTH,
+               GLYPH_ATLAS_HEIGHT, 0, GL_ALPHA, GL_UNSIGNED_BYTE, &pixels[0]);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  mBuilt = glGetError() == GL_NO_ERROR;
+  mFailed = !mBuilt;
+
+  return mBuilt;
+}
+
+// Lays out one quad per glyph relative to the string's origin, as (x, y, s, t)
+// vertices ready for glDrawArrays(GL_QUADS, ...).
+void GlyphAtlas::Layout(const char *text, TextLayout *layout) const {
+  const GLfloat cell = GLYPH_CELL_SIZE;
+  int pen = 0;
+  layout->vertices.clear();
+  for (const char *c = text; *c; ++c) {
+    int i = (unsigned char) *c - FIRST_GLYPH;
+    if (i < 0 || i >= NUM_GLYPHS) {
+      continue;
+    }
+    GLfloat x1 = pen;
+    GLfloat y1 = -GLYPH_DESCENT;
+    GLfloat s1 = (i % GLYPH_ATLAS_COLUMNS) * cell / GLYPH_ATLAS_WIDTH;
+    GLfloat t1 = (i / GLYPH_ATLAS_COLUMNS) * cell / GLYPH_ATLAS_HEIGHT;
+    GLfloat s2 = s1 + cell / GLYPH_ATLAS_WIDTH;
+    GLfloat t2 = t1 + cell / GLYPH_ATLAS_HEIGHT;
+    GLfloat quad[16] = {x1, y1, s1, t1,
+                        x1 + cell, y1, s2, t1,
+                        x1 + cell, y1 + cell, s2, t2,
+                        x1, y1 + cell, s1, t2};
+    layout->vertices.insert(layout->vertices.end(), quad, quad + 16);
+    pen += mAdvance[i];
+  }
+  layout->valid = true;
+}
+
+// Draws a laid-out string in the current color with its origin at (x, y),
+// snapped to whole pixels as glRasterPos would.
+void GlyphAtlas::Draw(double x, double y, const TextLayout &layout) const {
+  if (layout.vertices.empty()) {
+    return;
+  }
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.5f);
+  glPushMatrix();
+  glTranslated(floor(x), floor(y), 0);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), &layout.vertices[0]);
+  glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), &layout.vertices[2]);
+  glDrawArrays(GL_QUADS, 0, layout.vertices.size() / 4);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glPopMatrix();
+  glDisable(GL_ALPHA_TEST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_TEXTURE_2D);
+}
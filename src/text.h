@@ -0,0 +1,44 @@
+/*******************************************************************************
+   Filename: text.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for GlyphAtlas, which bakes the GLUT 9x15 bitmap font
+             into a texture once so whole strings can be drawn as batches of
+             textured quads.
+*******************************************************************************/
+
+#ifndef TEXT_H_
+#define TEXT_H_
+
+#include "draw.h"
+
+const int FIRST_GLYPH = 32;  // ' '
+const int LAST_GLYPH = 126;  // '~'
+const int NUM_GLYPHS = LAST_GLYPH - FIRST_GLYPH + 1;
+const int GLYPH_CELL_SIZE = 16;
+const int GLYPH_DESCENT = 4;  // rows of the 9x15 font below the baseline
+const int GLYPH_ATLAS_COLUMNS = 16;
+const int GLYPH_ATLAS_WIDTH = 256;
+const int GLYPH_ATLAS_HEIGHT = 128;
+
+class GlyphAtlas {
+ public:
+  GlyphAtlas();
+  ~GlyphAtlas();
+  bool Build();
+  bool IsBuilt() const { return mBuilt; }
+  // A failed build isn't tried again until AllowRetry, as when the window
+  // grows, since it draws over the back buffer and reads it back each time.
+  bool NeedsBuild() const { return !mBuilt && !mFailed; }
+  void AllowRetry() { mFailed = false; }
+  void Layout(const char *text, TextLayout *layout) const;
+  void Draw(double x, double y, const TextLayout &layout) const;
+ private:
+  GLuint mTexture;
+  int mAdvance[NUM_GLYPHS];
+  bool mBuilt;
+  bool mFailed;  // the last build failed
+};
+
+#endif  // TEXT_H_
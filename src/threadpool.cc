@@ -0,0 +1,175 @@
+/*******************************************************************************
+   Filename: threadpool.cc
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Method definitions for ThreadPool. A loop's iterations are dealt
+             out in contiguous blocks, one per thread (the calling thread
+             helps rather than waits), so neighboring iterations tend to run
+             on the same thread. A thread whose block runs dry steals the back
+             half of another's, so uneven iterations still balance.
+*******************************************************************************/
+
+#include "threadpool.h"
+
+static int gThreadCount = 0;  // 0 means one per hardware thread
+static ThreadPool *gThreadPool = NULL;
+static thread_local bool tInsidePool = false;
+
+ThreadPool::ThreadPool(int numThreads) : mQueues(max(numThreads, 1)) {
+  mBody = NULL;
+  mFinished = 0;
+  mSteals = 0;
+  mInlineLoops = 0;
+  mCount = 0;
+  mActive = 0;
+  mGeneration = 0;
+  mStopping = false;
+  for (int i = 0; i < (int) mQueues.size(); ++i) {
+    mQueues[i].begin = mQueues[i].end = 0;
+  }
+  for (int i = 1; i < (int) mQueues.size(); ++i) {
+    mWorkers.push_back(thread(&ThreadPool::WorkerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWake.notify_all();
+  vector<thread>::iterator iter;
+  for (iter = mWorkers.begin(); iter < mWorkers.end(); ++iter) {
+    iter->join();
+  }
+}
+
+// Calls body(i) for i = 0..n-1 across the pool and returns once every call
+// has. Loops started from inside a pool thread simply run inline, as do loops
+// started while another thread's loop has the pool, rather than wait for it;
+// those are counted. (The render thread has a pool of its own, so it never
+// holds this one.)
+void ThreadPool::ParallelFor(int n, const function<void (int)> &body) {
+  if (n <= 0) {
+    return;
+  }
+  unique_lock<mutex> serial(mSubmitMutex, defer_lock);
+  bool inlined = mWorkers.empty() || n == 1 || tInsidePool;
+  if (!inlined && !serial.try_lock()) {
+    ++mInlineLoops;
+    inlined = true;
+  }
+  if (inlined) {
+    for (int i = 0; i < n; ++i) {
+      body(i);
+    }
+    return;
+  }
+  {
+    // a worker that woke too late for the last loop may still be on its way
+    // out of RunIterations(), holding that loop's body
+    unique_lock<mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mActive == 0; });
+    int numQueues = mQueues.size();
+    for (int i = 0; i < numQueues; ++i) {
+      lock_guard<mutex> queueLock(mQueues[i].lock);
+      mQueues[i].begin = (long) n * i / numQueues;
+      mQueues[i].end = (long) n * (i + 1) / numQueues;
+    }
+    mBody = &body;
+    mCount = n;
+    mFinished = 0;
+    ++mGeneration;
+  }
+  mWake.notify_all();
+  tInsidePool = true;
+  RunIterations(0);
+  tInsidePool = false;
+  unique_lock<mutex> lock(mMutex);
+  mDone.wait(lock, [this] { return mFinished == mCount && mActive == 0; });
+}
+
+void ThreadPool::WorkerLoop(int index) {
+  unsigned long seen = 0;
+  tInsidePool = true;
+  unique_lock<mutex> lock(mMutex);
+  while (true) {
+    mWake.wait(lock, [&] { return mStopping || mGeneration != seen; });
+    if (mStopping) {
+      return;
+    }
+    seen = mGeneration;
+    ++mActive;
+    lock.unlock();
+    RunIterations(index);
+    lock.lock();
+    --mActive;
+    mDone.notify_all();
+  }
+}
+
+// Runs iterations from the thread's own queue, then from whatever it can
+// steal, until every queue is empty.
+void ThreadPool::RunIterations(int index) {
+  int i;
+  while (ClaimIteration(index, &i) || (StealIterations(index) &&
+                                       ClaimIteration(index, &i))) {
+    (*mBody)(i);
+    ++mFinished;
+  }
+}
+
+bool ThreadPool::ClaimIteration(int index, int *i) {
+  WorkQueue &queue = mQueues[index];
+  lock_guard<mutex> lock(queue.lock);
+  if (queue.begin == queue.end) {
+    return false;
+  }
+  *i = queue.begin++;
+
+  return true;
+}
+
+// Moves the back half of the first non-empty queue after the thief's own into
+// the thief's (now empty) queue. Only one queue is ever locked at a time.
+bool ThreadPool::StealIterations(int thief) {
+  int numQueues = mQueues.size();
+  for (int k = 1; k < numQueues; ++k) {
+    WorkQueue &victim = mQueues[(thief + k) % numQueues];
+    int begin, end;
+    {
+      lock_guard<mutex> lock(victim.lock);
+      if (victim.begin == victim.end) {
+        continue;
+      }
+      end = victim.end;
+      begin = victim.begin + (victim.end - victim.begin) / 2;
+      victim.end = begin;
+    }
+    lock_guard<mutex> lock(mQueues[thief].lock);
+    mQueues[thief].begin = begin;
+    mQueues[thief].end = end;
+    ++mSteals;
+    return true;
+  }
+
+  return false;
+}
+
+// Sets the size of the shared pool. Only has an effect before its first use.
+void SetThreadCount(int numThreads) {
+  gThreadCount = numThreads;
+}
+
+ThreadPool *GetThreadPool() {
+  if (!gThreadPool) {
+    int n = gThreadCount;
+    if (n <= 0) {
+      n = thread::hardware_concurrency();
+    }
+    gThreadPool = new ThreadPool(n > 0 ? n : 1);
+  }
+
+  return gThreadPool;
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************
+   Filename: threadpool.h
+
+     Author: David C. Drake (https://davidcdrake.com)
+
+Description: Header file for ThreadPool, a fixed set of worker threads that
+             run the iterations of a parallel loop, and for the pool shared by
+             loading, rendering and tessellation. Each thread starts with its
+             own contiguous share of a loop and steals from the others when it
+             finishes early.
+*******************************************************************************/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "draw.h"
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(int numThreads);
+  ~ThreadPool();
+  void ParallelFor(int n, const function<void (int)> &body);
+  int NumThreads() const { return mQueues.size(); }
+  long NumSteals() const { return mSteals; }
+  // loops run on the calling thread alone because another thread's loop had
+  // the pool
+  long NumInlineLoops() const { return mInlineLoops; }
+ private:
+  // The iterations of the current loop not yet claimed by one thread. Its
+  // owner takes them from the front; a thread that runs out steals the back
+  // half.
+  struct WorkQueue {
+    mutex lock;
+    int begin, end;
+  };
+  void WorkerLoop(int index);
+  void RunIterations(int index);
+  bool ClaimIteration(int index, int *i);
+  bool StealIterations(int thief);
+
+  vector<thread> mWorkers;
+  vector<WorkQueue> mQueues;  // one per thread; the caller's is first
+  mutex mSubmitMutex;  // one loop at a time
+  mutex mMutex;
+  condition_variable mWake, mDone;
+  const function<void (int)> *mBody;
+  atomic<int> mFinished;
+  atomic<long> mSteals;
+  atomic<long> mInlineLoops;
+  int mCount;
+  int mActive;  // workers inside RunIterations()
+  unsigned long mGeneration;
+  bool mStopping;
+};
+
+void SetThreadCount(int numThreads);
+ThreadPool *GetThreadPool();
+
+#endif  // THREADPOOL_H_